@@ -0,0 +1,171 @@
+#include "ArbitrageDetector.h"
+#include "CSVReader.h"
+#include <algorithm>
+#include <chrono>
+
+ArbitrageDetector::ArbitrageDetector(const std::vector<std::string>& _products, double _minProfit)
+: minProfit(_minProfit)
+{
+    for (const std::string& product : _products)
+    {
+        std::vector<std::string> currs = CSVReader::tokenise(product, '/');
+        if (currs.size() != 2 || productIndex.count(product) > 0)
+            continue;
+        productIndex[product] = products.size();
+        products.push_back(product);
+        int base = currencyIndex(currs[0]);
+        int quote = currencyIndex(currs[1]);
+        productCurrencies.push_back({base, quote});
+    }
+    size_t n = currencies.size();
+    tops.resize(products.size());
+    rates.assign(n * n, 0);
+    productCycles.resize(products.size());
+
+    // which product, if any, links each pair of currencies
+    std::vector<int> link(n * n, -1);
+    for (size_t p = 0; p < products.size(); ++p)
+    {
+        link[productCurrencies[p].first * n + productCurrencies[p].second] = p;
+        link[productCurrencies[p].second * n + productCurrencies[p].first] = p;
+    }
+
+    // every triangle, both ways round
+    for (int a = 0; a < int(n); ++a)
+    {
+        for (int b = a + 1; b < int(n); ++b)
+        {
+            for (int c = b + 1; c < int(n); ++c)
+            {
+                int ab = link[a * n + b];
+                int bc = link[b * n + c];
+                int ca = link[c * n + a];
+                if (ab < 0 || bc < 0 || ca < 0)
+                    continue;
+                Cycle forward{{a, b, c}, {ab, bc, ca}};
+                Cycle backward{{a, c, b}, {ca, bc, ab}};
+                for (const Cycle& cycle : {forward, backward})
+                {
+                    for (int p : cycle.products)
+                    {
+                        productCycles[p].push_back(cycles.size());
+                    }
+                    cycles.push_back(cycle);
+                }
+            }
+        }
+    }
+}
+
+int ArbitrageDetector::currencyIndex(const std::string& currency)
+{
+    auto it = std::find(currencies.begin(), currencies.end(), currency);
+    if (it != currencies.end())
+        return it - currencies.begin();
+    currencies.push_back(currency);
+    return currencies.size() - 1;
+}
+
+double& ArbitrageDetector::rate(int from, int to)
+{
+    return rates[from * currencies.size() + to];
+}
+
+unsigned int ArbitrageDetector::updateTopOfBook(const std::string& product, double bestBid, double bestAsk)
+{
+    auto it = productIndex.find(product);
+    if (it == productIndex.end())
+        return 0;
+    int p = it->second;
+    TopOfBook& top = tops[p];
+    if (top.bid == bestBid && top.ask == bestAsk)
+        return 0;
+    top.bid = bestBid;
+    top.ask = bestAsk;
+
+    // selling base at the bid, buying base with quote at the ask
+    int base = productCurrencies[p].first;
+    int quote = productCurrencies[p].second;
+    rate(base, quote) = bestBid;
+    rate(quote, base) = bestAsk > 0 ? 1 / bestAsk : 0;
+
+    for (int cycle : productCycles[p])
+    {
+        priceCycle(cycle);
+    }
+    return productCycles[p].size();
+}
+
+void ArbitrageDetector::priceCycle(int i)
+{
+    Cycle& cycle = cycles[i];
+    const int* c = cycle.currencies;
+    cycle.rate = rate(c[0], c[1]) * rate(c[1], c[2]) * rate(c[2], c[0]);
+    ++cyclesPriced;
+    if (cycle.rate > 1 + minProfit)
+        profitable.insert(i);
+    else
+        profitable.erase(i);
+}
+
+void ArbitrageDetector::onTimeframe(const OrderBook& orderBook,
+                                    const std::string& timestamp,
+                                    std::vector<ArbitrageOpportunity>& found)
+{
+    // one pass over the timeframe for every product's top of book
+    std::vector<TopOfBook> latest(products.size());
+    for (const OrderBookEntry& e : orderBook.getOrdersAt(timestamp))
+    {
+        auto it = productIndex.find(e.product);
+        if (it == productIndex.end())
+            continue;
+        TopOfBook& top = latest[it->second];
+        if (e.orderType == OrderBookType::bid && e.price > top.bid)
+            top.bid = e.price;
+        if (e.orderType == OrderBookType::ask && (top.ask == 0 || e.price < top.ask))
+            top.ask = e.price;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < products.size(); ++p)
+    {
+        updateTopOfBook(products[p], latest[p].bid, latest[p].ask);
+    }
+    for (int i : profitable)
+    {
+        const Cycle& cycle = cycles[i];
+        ArbitrageOpportunity opportunity{timestamp, {}, {}, cycle.rate};
+        for (int leg = 0; leg < 3; ++leg)
+        {
+            opportunity.path.push_back(currencies[cycle.currencies[leg]]);
+            opportunity.products.push_back(products[cycle.products[leg]]);
+        }
+        opportunity.path.push_back(currencies[cycle.currencies[0]]);
+        found.push_back(opportunity);
+    }
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    ++timeframes;
+    totalLatencyMicros += micros;
+    maxLatencyMicros = std::max(maxLatencyMicros, micros);
+}
+
+size_t ArbitrageDetector::getCycleCount() const
+{
+    return cycles.size();
+}
+
+unsigned long ArbitrageDetector::getCyclesPriced() const
+{
+    return cyclesPriced;
+}
+
+double ArbitrageDetector::getMeanLatencyMicros() const
+{
+    return timeframes == 0 ? 0 : totalLatencyMicros / timeframes;
+}
+
+double ArbitrageDetector::getMaxLatencyMicros() const
+{
+    return maxLatencyMicros;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "OrderBook.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** a profitable loop through three currencies, e.g. BTC -> ETH -> USDT -> BTC */
+struct ArbitrageOpportunity
+{
+    std::string timestamp;
+    /** the currencies in trading order, starting and ending at the same one */
+    std::vector<std::string> path;
+    /** the products traded, one per leg */
+    std::vector<std::string> products;
+    /** how much of the first currency one unit turns into, before fees */
+    double rate;
+};
+
+/** Keeps a graph of the currencies, with an edge for each side of each
+ * product's top of book, and watches every three-currency cycle in it.
+ *
+ * The cycles through each product are worked out once, up front. When a
+ * product's best bid or ask changes only those cycles are priced again,
+ * and the set of cycles currently above 1 + minProfit is kept up to date
+ * as they are.
+ */
+class ArbitrageDetector
+{
+    public:
+        ArbitrageDetector(const std::vector<std::string>& products, double minProfit = 0);
+
+    /** a new best bid/ask for product (0 for an empty side).
+     * returns the number of cycles it had to price again */
+        unsigned int updateTopOfBook(const std::string& product, double bestBid, double bestAsk);
+    /** take the top of book of every product in one timeframe of the
+     * book, then add the cycles that are profitable to found */
+        void onTimeframe(const OrderBook& orderBook,
+                         const std::string& timestamp,
+                         std::vector<ArbitrageOpportunity>& found);
+
+        size_t getCycleCount() const;
+    /** how many cycles have been priced, in total */
+        unsigned long getCyclesPriced() const;
+    /** time from a timeframe's top of book being known to its
+     * opportunities being found, in microseconds */
+        double getMeanLatencyMicros() const;
+        double getMaxLatencyMicros() const;
+
+    private:
+        /** a directed cycle a -> b -> c -> a */
+        struct Cycle
+        {
+            int currencies[3];
+            int products[3];
+            double rate = 0;
+        };
+        struct TopOfBook
+        {
+            double bid = 0;
+            double ask = 0;
+        };
+
+        int currencyIndex(const std::string& currency);
+        void priceCycle(int cycle);
+        /** amount of currency `to` one unit of `from` buys, 0 if no edge */
+        double& rate(int from, int to);
+
+        double minProfit;
+        std::vector<std::string> currencies;
+        std::vector<std::string> products;
+        std::unordered_map<std::string, int> productIndex;
+        /** base and quote currency of each product */
+        std::vector<std::pair<int, int>> productCurrencies;
+        std::vector<TopOfBook> tops;
+        /** currencies x currencies, row = from */
+        std::vector<double> rates;
+        std::vector<Cycle> cycles;
+        /** cycles that use each product */
+        std::vector<std::vector<int>> productCycles;
+        std::set<int> profitable;
+
+        unsigned long cyclesPriced = 0;
+        unsigned long timeframes = 0;
+        double totalLatencyMicros = 0;
+        double maxLatencyMicros = 0;
+};
@@ -0,0 +1,319 @@
+#include "Backtester.h"
+#include "CSVReader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+Backtester::Backtester(const OrderBook& orderBook, std::string _quoteCurrency)
+: timeline(orderBook.getAllOrders()),
+  quoteCurrency(_quoteCurrency)
+{
+    products = timeline.getKnownProducts();
+    for (const std::string& product : products)
+    {
+        std::vector<std::string> currs = CSVReader::tokenise(product, '/');
+        if (currs.size() == 2)
+            productCurrencies.emplace_back(currs[0], currs[1]);
+        else
+            productCurrencies.emplace_back();
+    }
+    for (const Timeframe& frame : timeline.getTimeframes())
+    {
+        std::vector<const ProductFrame*> byIndex(products.size(), nullptr);
+        for (const ProductFrame& p : frame.products)
+        {
+            byIndex[getProductIndex(p.product)] = &p;
+        }
+        frameProducts.push_back(byIndex);
+    }
+
+    for (const Timeframe& frame : timeline.getTimeframes())
+    {
+        for (const ProductFrame& p : frame.products)
+        {
+            if (!p.asks.empty() && !p.bids.empty())
+                marks[p.product] = (p.asks[0].price + p.bids[0].price) / 2;
+        }
+    }
+}
+
+void Backtester::addStrategy(std::unique_ptr<TradingStrategy> strategy, const Wallet& startingWallet)
+{
+    strategies.push_back(std::move(strategy));
+    startingWallets.push_back(startingWallet);
+}
+
+const std::vector<std::string>& Backtester::getKnownProducts() const
+{
+    return products;
+}
+
+int Backtester::getProductIndex(const std::string& product) const
+{
+    auto it = std::lower_bound(products.begin(), products.end(), product);
+    if (it == products.end() || *it != product)
+        return -1;
+    return int(it - products.begin());
+}
+
+std::vector<BacktestResult> Backtester::run(unsigned int threads)
+{
+    std::vector<BacktestResult> results(strategies.size());
+    runParallel(strategies.size(), threads, [this, &results](size_t i)
+    {
+        results[i] = runStrategy(i);
+    });
+    return results;
+}
+
+void Backtester::runParallel(size_t count, unsigned int threads, std::function<void(size_t)> job)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<unsigned int>(threads, std::max<size_t>(1, count));
+
+    auto start = std::chrono::steady_clock::now();
+
+    // each worker takes the next instance that nobody has started yet
+    std::atomic<size_t> next{0};
+    auto worker = [count, &next, &job]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            job(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+
+    lastRunSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lastRunThreads = threads;
+    lastRunInstances = count;
+}
+
+BacktestResult Backtester::runStrategy(size_t index) const
+{
+    TradingStrategy& strategy = *strategies[index];
+    BacktestResult result;
+    result.name = strategy.getName();
+    Wallet wallet = startingWallets[index];
+
+    // scratch space, reused for every timeframe
+    std::vector<OrderBookEntry> placed;
+    MatchScratch scratch;
+
+    for (const Timeframe& frame : timeline.getTimeframes())
+    {
+        placed.clear();
+        strategy.onTimeframe(frame, wallet, placed);
+        settleOrders(frame, placed, wallet, result, scratch);
+    }
+
+    finishResult(startingWallets[index], wallet, result);
+    return result;
+}
+
+void Backtester::settleOrders(const Timeframe& frame,
+                              std::vector<OrderBookEntry>& placed,
+                              Wallet& wallet,
+                              BacktestResult& result,
+                              MatchScratch& scratch) const
+{
+    std::vector<std::string>& products = scratch.products;
+    products.clear();
+    size_t kept = 0;
+    unsigned long orderId = 0;
+    for (OrderBookEntry& order : placed)
+    {
+        order.timestamp = frame.timestamp;
+        order.username = "simuser";
+        // ids only need to be unique within the timeframe
+        order.orderId = ++orderId;
+        ++result.ordersPlaced;
+        if (!wallet.reserveOrder(order))
+        {
+            ++result.ordersRejected;
+            continue;
+        }
+        if (std::find(products.begin(), products.end(), order.product) == products.end())
+            products.push_back(order.product);
+        placed[kept++] = order;
+    }
+    placed.erase(placed.begin() + kept, placed.end());
+
+    // only the products we have orders in can change our wallet
+    for (const std::string& product : products)
+    {
+        std::vector<std::string> currs = CSVReader::tokenise(product, '/');
+        if (currs.size() != 2)
+            continue;
+        scratch.own.clear();
+        for (const OrderBookEntry& order : placed)
+        {
+            if (order.product == product)
+                scratch.own.push_back(OwnOrder{order.orderType, order.price, order.amount, order.orderId});
+        }
+        matchOwnOrders(frame.findProduct(product), currs[0], currs[1], wallet, result, scratch);
+    }
+    wallet.releaseTimeframe(frame.timestamp);
+}
+
+void Backtester::matchOwnOrders(const ProductFrame* frame,
+                                const std::string& base,
+                                const std::string& quote,
+                                Wallet& wallet,
+                                BacktestResult& result,
+                                MatchScratch& scratch) const
+{
+    // merge our orders into each side of the dataset's, which is already
+    // sorted. ours go after dataset orders at the same price, and after
+    // our own earlier ones, as inserting them at upper_bound would
+    auto mergeSide = [&scratch](const std::vector<OrderBookEntry>* dataset,
+                                OrderBookType type,
+                                bool ascending,
+                                std::vector<Resting>& side)
+    {
+        std::vector<const OwnOrder*>& own = scratch.ownSide;
+        own.clear();
+        for (const OwnOrder& order : scratch.own)
+        {
+            if (order.orderType == type)
+                own.push_back(&order);
+        }
+        auto before = [ascending](double a, double b) { return ascending ? a < b : a > b; };
+        std::stable_sort(own.begin(), own.end(), [&before](const OwnOrder* a, const OwnOrder* b)
+                         { return before(a->price, b->price); });
+
+        side.clear();
+        size_t d = 0;
+        size_t count = dataset == nullptr ? 0 : dataset->size();
+        for (const OwnOrder* order : own)
+        {
+            for (; d < count && !before(order->price, (*dataset)[d].price); ++d)
+                side.push_back(Resting{&(*dataset)[d], nullptr, (*dataset)[d].price, (*dataset)[d].amount});
+            side.push_back(Resting{nullptr, order, order->price, order->amount});
+        }
+        for (; d < count; ++d)
+            side.push_back(Resting{&(*dataset)[d], nullptr, (*dataset)[d].price, (*dataset)[d].amount});
+    };
+    std::vector<Resting>& asks = scratch.asks;
+    std::vector<Resting>& bids = scratch.bids;
+    mergeSide(frame == nullptr ? nullptr : &frame->asks, OrderBookType::ask, true, asks);
+    mergeSide(frame == nullptr ? nullptr : &frame->bids, OrderBookType::bid, false, bids);
+
+    // the same rules as OrderBook::matchSortedOrders, but only our fills
+    // are kept, and they go straight to the wallet
+    for (Resting& ask : asks)
+    {
+        for (Resting& bid : bids)
+        {
+            // bids are sorted high to low, so none of the rest can match either
+            if (bid.price < ask.price)
+                break;
+
+            double amount;
+            bool askFilled;
+            if (bid.amount == ask.amount || bid.amount > ask.amount)
+            {
+                amount = ask.amount;
+                askFilled = true;
+            }
+            else if (bid.amount > 0)
+            {
+                amount = bid.amount;
+                askFilled = false;
+            }
+            else
+            {
+                continue;
+            }
+            bid.amount -= amount;
+            ask.amount -= amount;
+
+            // an ask of ours takes precedence, as it does in matchSortedOrders
+            if (ask.own != nullptr)
+            {
+                if (wallet.processSale(base, quote, OrderBookType::asksale, ask.price, amount, ask.own->orderId))
+                    ++result.fills;
+            }
+            else if (bid.own != nullptr)
+            {
+                if (wallet.processSale(base, quote, OrderBookType::bidsale, ask.price, amount, bid.own->orderId))
+                    ++result.fills;
+            }
+            if (askFilled)
+                break;
+        }
+    }
+}
+
+void Backtester::finishResult(const Wallet& startingWallet,
+                              const Wallet& finalWallet,
+                              BacktestResult& result) const
+{
+    result.startValue = valueWallet(startingWallet);
+    result.endValue = valueWallet(finalWallet);
+    result.pnl = result.endValue - result.startValue;
+    result.finalWallet = finalWallet;
+}
+
+double Backtester::valueWallet(const Wallet& wallet) const
+{
+    double value = 0;
+    for (const auto& pair : wallet.getCurrencies())
+    {
+        const std::string& currency = pair.first;
+        double amount = pair.second;
+        if (currency == quoteCurrency)
+        {
+            value += amount;
+            continue;
+        }
+        auto direct = marks.find(currency + "/" + quoteCurrency);
+        if (direct != marks.end())
+        {
+            value += amount * direct->second;
+            continue;
+        }
+        auto inverse = marks.find(quoteCurrency + "/" + currency);
+        if (inverse != marks.end() && inverse->second != 0)
+        {
+            value += amount / inverse->second;
+        }
+    }
+    return value;
+}
+
+void Backtester::printResults(const std::vector<BacktestResult>& results) const
+{
+    for (const BacktestResult& r : results)
+    {
+        std::cout << r.name
+                  << " orders: " << r.ordersPlaced
+                  << " rejected: " << r.ordersRejected;
+        if (r.ordersDropped > 0)
+            std::cout << " dropped: " << r.ordersDropped;
+        std::cout << " fills: " << r.fills
+                  << " PnL: " << r.pnl << " " << quoteCurrency << std::endl;
+    }
+
+    double frames = double(timeline.getTimeframes().size()) * lastRunInstances;
+    std::cout << "Backtester::run " << lastRunInstances << " strategies x "
+              << timeline.getTimeframes().size() << " timeframes on "
+              << lastRunThreads << " threads in " << lastRunSeconds << "s ("
+              << (lastRunSeconds > 0 ? frames / lastRunSeconds : 0)
+              << " strategy-timeframes/s)" << std::endl;
+}
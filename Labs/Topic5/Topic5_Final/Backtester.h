@@ -0,0 +1,224 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "MarketTimeline.h"
+#include "TradingStrategy.h"
+#include "StaticStrategy.h"
+#include "Wallet.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** how one strategy instance got on over a backtest */
+struct BacktestResult
+{
+    std::string name;
+    Wallet finalWallet;
+    /** starting and final wallet value in the quote currency */
+    double startValue = 0;
+    double endValue = 0;
+    double pnl = 0;
+    unsigned long ordersPlaced = 0;
+    /** orders dropped because the wallet could not cover them */
+    unsigned long ordersRejected = 0;
+    /** orders a static strategy emitted past its OrderBuffer's capacity,
+     * which were never placed */
+    unsigned long ordersDropped = 0;
+    unsigned long fills = 0;
+};
+
+/** Replays the order book history against many independent strategy
+ * instances in parallel. Every instance has its own wallet and orders;
+ * the market data is one shared, read-only MarketTimeline.
+ */
+class Backtester
+{
+    public:
+    /** build the timeline from the book. wallets are valued in quoteCurrency */
+        Backtester(const OrderBook& orderBook, std::string quoteCurrency = "USDT");
+
+        void addStrategy(std::unique_ptr<TradingStrategy> strategy, const Wallet& startingWallet);
+
+    /** run every strategy over the whole timeline, in the order they were
+     * added. threads = 0 means use all cores */
+        std::vector<BacktestResult> run(unsigned int threads = 0);
+
+    /** run statically dispatched strategies (see StaticStrategy.h), each
+     * starting with a copy of startingWallet. results are in the same order
+     * as strategies. threads = 0 means use all cores */
+        template <typename Strategy>
+        std::vector<BacktestResult> runStatic(std::vector<Strategy>& strategies,
+                                              const Wallet& startingWallet,
+                                              unsigned int threads = 0);
+
+    /** every product in the timeline, sorted by name.
+     * static strategies refer to products by their index in this list */
+        const std::vector<std::string>& getKnownProducts() const;
+    /** index of product in getKnownProducts, or -1 if it is not there */
+        int getProductIndex(const std::string& product) const;
+
+    /** value a wallet in the quote currency using the last mid price seen
+     * for each product. currencies with no price are left out */
+        double valueWallet(const Wallet& wallet) const;
+
+    /** print per-strategy PnL and the throughput of the last run */
+        void printResults(const std::vector<BacktestResult>& results) const;
+
+    private:
+        /** one of our orders that the wallet could cover */
+        struct OwnOrder
+        {
+            OrderBookType orderType;
+            double price;
+            double amount;
+            unsigned long orderId;
+        };
+        /** an order on one side of a product's book while it is matched:
+         * either a dataset order in the shared timeline or one of ours,
+         * with how much of it is left to fill */
+        struct Resting
+        {
+            const OrderBookEntry* dataset;
+            const OwnOrder* own;
+            double price;
+            double amount;
+        };
+        /** buffers reused across timeframes by one strategy instance */
+        struct MatchScratch
+        {
+            std::vector<Resting> asks;
+            std::vector<Resting> bids;
+            /** our orders in the product being matched */
+            std::vector<OwnOrder> own;
+            std::vector<const OwnOrder*> ownSide;
+            std::vector<std::string> products;
+        };
+
+        BacktestResult runStrategy(size_t index) const;
+        /** call job(0) .. job(count - 1) spread across threads, and time it */
+        void runParallel(size_t count, unsigned int threads, std::function<void(size_t)> job);
+        /** drop the orders the wallet cannot cover, match the rest against
+         * this timeframe's dataset orders and apply our fills to the wallet */
+        void settleOrders(const Timeframe& frame,
+                          std::vector<OrderBookEntry>& placed,
+                          Wallet& wallet,
+                          BacktestResult& result,
+                          MatchScratch& scratch) const;
+        /** match scratch.own, our orders in one product, against the
+         * dataset's orders in frame (which may be nullptr) as
+         * OrderBook::matchSortedOrders would, and apply our fills to the
+         * wallet. the frame is only read, never copied */
+        void matchOwnOrders(const ProductFrame* frame,
+                            const std::string& base,
+                            const std::string& quote,
+                            Wallet& wallet,
+                            BacktestResult& result,
+                            MatchScratch& scratch) const;
+        void finishResult(const Wallet& startingWallet,
+                          const Wallet& finalWallet,
+                          BacktestResult& result) const;
+
+        MarketTimeline timeline;
+        std::vector<std::string> products;
+        /** each product split into the currency it prices and the one it
+         * is priced in, by product index. empty if it is not X/Y */
+        std::vector<std::pair<std::string, std::string>> productCurrencies;
+        /** for each timeframe, its ProductFrame for each product index */
+        std::vector<std::vector<const ProductFrame*>> frameProducts;
+        std::string quoteCurrency;
+        /** last mid price seen for each product */
+        std::map<std::string, double> marks;
+
+        std::vector<std::unique_ptr<TradingStrategy>> strategies;
+        std::vector<Wallet> startingWallets;
+
+        double lastRunSeconds = 0;
+        unsigned int lastRunThreads = 0;
+        size_t lastRunInstances = 0;
+};
+
+template <typename Strategy>
+std::vector<BacktestResult> Backtester::runStatic(std::vector<Strategy>& strategies,
+                                                  const Wallet& startingWallet,
+                                                  unsigned int threads)
+{
+    static_assert(IsStaticStrategy<Strategy>::value,
+                  "Strategy needs void onTimeframe(const TimeframeView&, const Wallet&, OrderBuffer&)"
+                  " and std::string getName() const");
+
+    std::vector<BacktestResult> results(strategies.size());
+    runParallel(strategies.size(), threads, [this, &strategies, &startingWallet, &results](size_t i)
+    {
+        Strategy& strategy = strategies[i];
+        BacktestResult& result = results[i];
+        result.name = strategy.getName();
+        Wallet wallet = startingWallet;
+
+        OrderBuffer buffer;
+        MatchScratch scratch;
+        // the intents the wallet could cover, and the products they are in
+        std::vector<size_t> accepted;
+        std::vector<unsigned int> ordered;
+
+        const std::vector<Timeframe>& frames = timeline.getTimeframes();
+        for (size_t f = 0; f < frames.size(); ++f)
+        {
+            buffer.clear();
+            strategy.onTimeframe(TimeframeView{frames[f], frameProducts[f]}, wallet, buffer);
+            result.ordersDropped += buffer.getDropped();
+            if (buffer.size() == 0)
+                continue;
+
+            // reserve each intent straight from its product index; no
+            // strings are built, and nothing is parsed
+            accepted.clear();
+            ordered.clear();
+            for (size_t o = 0; o < buffer.size(); ++o)
+            {
+                const OrderIntent& intent = buffer[o];
+                ++result.ordersPlaced;
+                if (intent.product >= productCurrencies.size())
+                {
+                    ++result.ordersRejected;
+                    continue;
+                }
+                const std::pair<std::string, std::string>& currs = productCurrencies[intent.product];
+                bool ask = intent.orderType == OrderBookType::ask;
+                if (currs.first.empty() ||
+                    (!ask && intent.orderType != OrderBookType::bid) ||
+                    !wallet.reserve(o + 1, ask ? currs.first : currs.second,
+                                    ask ? intent.amount : intent.amount * intent.price,
+                                    frames[f].timestamp))
+                {
+                    ++result.ordersRejected;
+                    continue;
+                }
+                accepted.push_back(o);
+                if (std::find(ordered.begin(), ordered.end(), intent.product) == ordered.end())
+                    ordered.push_back(intent.product);
+            }
+
+            for (unsigned int product : ordered)
+            {
+                scratch.own.clear();
+                for (size_t o : accepted)
+                {
+                    const OrderIntent& intent = buffer[o];
+                    // ids only need to be unique within the timeframe
+                    if (intent.product == product)
+                        scratch.own.push_back(OwnOrder{intent.orderType, intent.price, intent.amount, o + 1});
+                }
+                matchOwnOrders(frameProducts[f][product], productCurrencies[product].first,
+                               productCurrencies[product].second, wallet, result, scratch);
+            }
+            wallet.releaseTimeframe(frames[f].timestamp);
+        }
+
+        finishResult(startingWallet, wallet, result);
+    });
+    return results;
+}
@@ -0,0 +1,31 @@
+#include "BandStrategy.h"
+
+BandStrategy::BandStrategy(std::string _product, double _band, double _amount)
+: product(_product),
+  band(_band),
+  amount(_amount)
+{
+
+}
+
+std::string BandStrategy::getName()
+{
+    return "band " + product + " " + std::to_string(band * 100) + "%";
+}
+
+void BandStrategy::onTimeframe(const Timeframe& frame,
+                               const Wallet& /*wallet*/,
+                               std::vector<OrderBookEntry>& orders)
+{
+    const ProductFrame* p = frame.findProduct(product);
+    if (p == nullptr || p->asks.empty() || p->bids.empty())
+    {
+        return;
+    }
+    double mid = (p->asks[0].price + p->bids[0].price) / 2;
+
+    orders.push_back(OrderBookEntry{mid * (1 - band), amount, frame.timestamp,
+                                    product, OrderBookType::bid});
+    orders.push_back(OrderBookEntry{mid * (1 + band), amount, frame.timestamp,
+                                    product, OrderBookType::ask});
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "TradingStrategy.h"
+
+/** Quotes one product either side of the mid price: a bid band% below
+ * and an ask band% above, each for a fixed amount.
+ */
+class BandStrategy : public TradingStrategy
+{
+    public:
+        BandStrategy(std::string product, double band, double amount);
+
+        std::string getName() override;
+        void onTimeframe(const Timeframe& frame,
+                         const Wallet& wallet,
+                         std::vector<OrderBookEntry>& orders) override;
+
+    private:
+        std::string product;
+        /** fraction of the mid price, e.g. 0.01 for 1% */
+        double band;
+        double amount;
+};
@@ -0,0 +1,83 @@
+#include "BookHistory.h"
+#include <algorithm>
+
+BookHistory::BookHistory(size_t _checkpointInterval)
+: checkpointInterval(std::max<size_t>(1, _checkpointInterval))
+{
+    checkpoints.push_back(Checkpoint{0, 0, live});
+}
+
+void BookHistory::append(const FeedMessage& message)
+{
+    deltas.push_back(message);
+    live.apply(message);
+    if (deltas.size() % checkpointInterval == 0)
+    {
+        checkpoints.push_back(Checkpoint{deltas.size(), message.timestamp, live});
+    }
+}
+
+FeedBook BookHistory::bookAt(const std::string& timestamp) const
+{
+    uint64_t micros = MarketDataFeed::timestampToMicros(timestamp);
+    // snap to the last time actually on the feed
+    auto last = std::partition_point(deltas.begin(), deltas.end(),
+                                     [micros](const FeedMessage& m)
+                                     { return m.timestamp <= micros; });
+    if (last != deltas.begin())
+    {
+        micros = (last - 1)->timestamp;
+    }
+    // the last checkpoint holding nothing stamped at or after micros.
+    // feed timestamps never go backwards, so these are in order
+    auto it = std::partition_point(checkpoints.begin() + 1, checkpoints.end(),
+                                   [micros](const Checkpoint& c)
+                                   { return c.timestamp < micros; });
+    const Checkpoint& checkpoint = *(it - 1);
+
+    FeedBook book = checkpoint.book;
+    size_t i = checkpoint.next;
+    for (; i < deltas.size() && deltas[i].timestamp < micros; ++i)
+    {
+        book.apply(deltas[i]);
+    }
+    for (; i < deltas.size() && deltas[i].timestamp == micros; ++i)
+    {
+        if (deltas[i].type == FeedMessageType::add || deltas[i].type == FeedMessageType::product)
+            book.apply(deltas[i]);
+    }
+    lastDeltaCount = i - checkpoint.next;
+    return book;
+}
+
+FeedBook BookHistory::bookAtSequence(uint64_t sequence) const
+{
+    auto end = std::partition_point(deltas.begin(), deltas.end(),
+                                    [sequence](const FeedMessage& m)
+                                    { return m.sequence <= sequence; });
+    size_t count = end - deltas.begin();
+    const Checkpoint& checkpoint = checkpoints[std::min(count / checkpointInterval, checkpoints.size() - 1)];
+
+    FeedBook book = checkpoint.book;
+    for (size_t i = checkpoint.next; i < count; ++i)
+    {
+        book.apply(deltas[i]);
+    }
+    lastDeltaCount = count - checkpoint.next;
+    return book;
+}
+
+size_t BookHistory::getMessageCount() const
+{
+    return deltas.size();
+}
+
+size_t BookHistory::getCheckpointCount() const
+{
+    return checkpoints.size();
+}
+
+size_t BookHistory::getLastDeltaCount() const
+{
+    return lastDeltaCount;
+}
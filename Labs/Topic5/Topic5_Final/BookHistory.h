@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FeedBook.h"
+#include "MarketDataFeed.h"
+#include <string>
+#include <vector>
+
+/** Answers "what did the book look like at time t" from a MarketDataFeed
+ * without replaying it from the start.
+ *
+ * Every message is kept as a delta log, and every checkpointInterval
+ * messages a full copy of the FeedBook is taken as a checkpoint. A query
+ * copies the last checkpoint before the time asked for and applies at
+ * most checkpointInterval deltas (plus those stamped with the time
+ * itself) on top of it.
+ */
+class BookHistory
+{
+    public:
+        BookHistory(size_t checkpointInterval = 1024);
+
+    /** add the next message of the feed */
+        void append(const FeedMessage& message);
+
+    /** the book as orders arrived at the last time on the feed at or before
+     * timestamp: everything stamped earlier, plus the orders added at that
+     * time, but nothing that traded or was cancelled at it. in MerkelRex
+     * terms, the timeframe in force at timestamp before it was matched */
+        FeedBook bookAt(const std::string& timestamp) const;
+    /** the book just after the message with this sequence number */
+        FeedBook bookAtSequence(uint64_t sequence) const;
+
+        size_t getMessageCount() const;
+        size_t getCheckpointCount() const;
+    /** how many deltas the last query applied on top of its checkpoint */
+        size_t getLastDeltaCount() const;
+
+    private:
+        struct Checkpoint
+        {
+            /** index of the first message not yet applied to book */
+            size_t next;
+            /** timestamp of the last message applied, 0 for the empty book */
+            uint64_t timestamp;
+            FeedBook book;
+        };
+
+        size_t checkpointInterval;
+        std::vector<FeedMessage> deltas;
+        std::vector<Checkpoint> checkpoints;
+        /** the book after every message so far */
+        FeedBook live;
+        mutable size_t lastDeltaCount = 0;
+};
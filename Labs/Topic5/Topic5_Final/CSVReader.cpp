@@ -1,6 +1,12 @@
 #include "CSVReader.h"
+#include "ThreadPlacement.h"
+#include "Profiler.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <functional>
 
 CSVReader::CSVReader()
 {
@@ -9,26 +15,151 @@ CSVReader::CSVReader()
 
 std::vector<OrderBookEntry> CSVReader::readCSV(std::string csvFilename)
 {
+    CSVReadStats stats;
+    std::vector<OrderBookEntry> entries = readCSV(csvFilename, stats);
+
+    std::cout << "CSVReader::readCSV read " << entries.size() << " entries" << std::endl;
+    if (stats.totalRejected() > 0)
+    {
+        std::cout << "CSVReader::readCSV rejected " << stats.totalRejected()
+                  << " rows (bad lines: " << stats.badLines
+                  << ", bad floats: " << stats.badFloats << ") at lines";
+        for (unsigned long lineNumber : stats.sampleLineNumbers)
+        {
+            std::cout << " " << lineNumber;
+        }
+        if (stats.totalRejected() > stats.sampleLineNumbers.size())
+        {
+            std::cout << " ...";
+        }
+        std::cout << std::endl;
+    }
+    return entries;
+}
+
+std::vector<OrderBookEntry> CSVReader::readCSV(std::string csvFilename,
+                                               CSVReadStats& stats,
+                                               unsigned int threads)
+{
+    PROFILE_SCOPE(parse);
     std::vector<OrderBookEntry> entries;
 
-    std::ifstream csvFile{csvFilename};
-    std::string line;
-    if (csvFile.is_open())
+    std::ifstream csvFile{csvFilename, std::ios::binary};
+    if (!csvFile.is_open())
+    {
+        return entries;
+    }
+    std::string data{std::istreambuf_iterator<char>{csvFile},
+                     std::istreambuf_iterator<char>{}};
+
+    // don't bother spinning up a thread for less than this much text
+    const size_t minChunkSize = 64 * 1024;
+    if (threads == 0)
     {
-        while(std::getline(csvFile, line))
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t chunkCount = std::min<size_t>(threads, data.size() / minChunkSize + 1);
+
+    // chunk boundaries, each one moved forward to just after a newline
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunkCount; ++i)
+    {
+        size_t pos = std::max(bounds.back(), data.size() * i / chunkCount);
+        pos = data.find('\n', pos);
+        if (pos == std::string::npos) break;
+        bounds.push_back(pos + 1);
+    }
+    bounds.push_back(data.size());
+    chunkCount = bounds.size() - 1;
+
+    std::vector<std::vector<OrderBookEntry>> chunkEntries(chunkCount);
+    std::vector<CSVReadStats> chunkStats(chunkCount);
+    std::vector<unsigned long> chunkLines(chunkCount, 0);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunkCount; ++i)
+    {
+        workers.emplace_back([&, i]
+        {
+            PlacedThread placed{ThreadRole::parser, "parser" + std::to_string(i), static_cast<int>(i)};
+            parseChunk(data, bounds[i], bounds[i + 1], chunkEntries[i], chunkStats[i], chunkLines[i]);
+        });
+    }
+    // this thread takes the first chunk
+    parseChunk(data, bounds[0], bounds[1], chunkEntries[0], chunkStats[0], chunkLines[0]);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    // merge in file order, turning chunk-relative line numbers into file ones
+    size_t total = 0;
+    for (std::vector<OrderBookEntry>& chunk : chunkEntries)
+    {
+        total += chunk.size();
+    }
+    entries.reserve(total);
+    unsigned long firstLine = 0;
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        entries.insert(entries.end(),
+                       std::make_move_iterator(chunkEntries[i].begin()),
+                       std::make_move_iterator(chunkEntries[i].end()));
+        stats.badLines += chunkStats[i].badLines;
+        stats.badFloats += chunkStats[i].badFloats;
+        for (unsigned long lineNumber : chunkStats[i].sampleLineNumbers)
+        {
+            if (stats.sampleLineNumbers.size() >= CSVReadStats::maxSampleLines) break;
+            stats.sampleLineNumbers.push_back(firstLine + lineNumber);
+        }
+        firstLine += chunkLines[i];
+    }
+    PROFILE_ITEMS(parse, entries.size());
+
+    return entries;
+}
+
+void CSVReader::parseChunk(const std::string& data,
+                           size_t begin,
+                           size_t end,
+                           std::vector<OrderBookEntry>& entries,
+                           CSVReadStats& stats,
+                           unsigned long& lineCount)
+{
+    // rough guess at the row length so we don't keep regrowing
+    entries.reserve((end - begin) / 60);
+
+    size_t start = begin;
+    while (start < end)
+    {
+        size_t stop = data.find('\n', start);
+        if (stop == std::string::npos || stop > end) stop = end;
+        std::string line = data.substr(start, stop - start);
+        start = stop + 1;
+        ++lineCount;
+
+        std::vector<std::string> tokens = tokenise(line, ',');
+        bool bad = false;
+        if (tokens.size() != 5)
+        {
+            ++stats.badLines;
+            bad = true;
+        }
+        else
         {
             try {
-                OrderBookEntry obe = stringsToOBE(tokenise(line, ','));
-                entries.push_back(obe);
+                entries.push_back(stringsToOBE(tokens));
             }catch(const std::exception& e)
             {
-                std::cout << "CSVReader::readCSV bad data"  << std::endl;
+                ++stats.badFloats;
+                bad = true;
             }
-        }// end of while
-    }    
-
-    std::cout << "CSVReader::readCSV read " << entries.size() << " entries"  << std::endl;
-    return entries; 
+        }
+        if (bad && stats.sampleLineNumbers.size() < CSVReadStats::maxSampleLines)
+        {
+            stats.sampleLineNumbers.push_back(lineCount);
+        }
+    }
 }
 
 std::vector<std::string> CSVReader::tokenise(std::string csvLine, char separator)
@@ -55,18 +186,11 @@ OrderBookEntry CSVReader::stringsToOBE(std::vector<std::string> tokens)
 
     if (tokens.size() != 5) // bad
     {
-        std::cout << "Bad line " << std::endl;
         throw std::exception{};
     }
-    // we have 5 tokens
-    try {
-         price = std::stod(tokens[3]);
-         amount = std::stod(tokens[4]);
-    }catch(const std::exception& e){
-        std::cout << "CSVReader::stringsToOBE Bad float! " << tokens[3]<< std::endl;
-        std::cout << "CSVReader::stringsToOBE Bad float! " << tokens[4]<< std::endl; 
-        throw;        
-    }
+    // we have 5 tokens. readCSV counts the failures, so no printing here
+    price = std::stod(tokens[3]);
+    amount = std::stod(tokens[4]);
 
     OrderBookEntry obe{price, 
                         amount, 
@@ -4,21 +4,50 @@
 #include <vector>
 #include <string>
 
+/** tally of the rows readCSV had to reject, by reason */
+struct CSVReadStats
+{
+    /** rows that did not split into exactly 5 fields (includes blank lines) */
+    unsigned long badLines = 0;
+    /** rows whose price or amount could not be read as a number */
+    unsigned long badFloats = 0;
+    /** 1-based line numbers of the first few rejected rows, in file order */
+    std::vector<unsigned long> sampleLineNumbers;
+    /** how many line numbers we keep in sampleLineNumbers */
+    static const unsigned int maxSampleLines = 10;
+
+    unsigned long totalRejected() const { return badLines + badFloats; }
+};
+
 class CSVReader
 {
     public:
      CSVReader();
 
      static std::vector<OrderBookEntry> readCSV(std::string csvFile);
+     /** read the file in newline-aligned chunks, one thread per chunk,
+      * and fill in stats instead of printing every bad row.
+      * threads = 0 means use all cores */
+     static std::vector<OrderBookEntry> readCSV(std::string csvFile,
+                                                CSVReadStats& stats,
+                                                unsigned int threads = 0);
      static std::vector<std::string> tokenise(std::string csvLine, char separator);
-    
-     static OrderBookEntry stringsToOBE(std::string price, 
-                                        std::string amount, 
-                                        std::string timestamp, 
-                                        std::string product, 
+
+     static OrderBookEntry stringsToOBE(std::string price,
+                                        std::string amount,
+                                        std::string timestamp,
+                                        std::string product,
                                         OrderBookType OrderBookType);
 
     private:
      static OrderBookEntry stringsToOBE(std::vector<std::string> strings);
-     
-};
\ No newline at end of file
+     /** parse the lines in data[begin, end), counting lines as it goes.
+      * sample line numbers are relative to the start of the chunk */
+     static void parseChunk(const std::string& data,
+                            size_t begin,
+                            size_t end,
+                            std::vector<OrderBookEntry>& entries,
+                            CSVReadStats& stats,
+                            unsigned long& lineCount);
+
+};
@@ -0,0 +1,176 @@
+#include "DifferentialReplay.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+DifferentialReplay::DifferentialReplay(OrderBook& _orderBook, const Wallet& _startingWallet)
+: orderBook(_orderBook), startingWallet(_startingWallet)
+{
+    for (const OrderSpan &frame : orderBook.getTimeframes())
+    {
+        timestamps.push_back(frame[0].timestamp);
+    }
+}
+
+void DifferentialReplay::addEngine(std::string name, MatchEngine engine)
+{
+    engines.push_back({name, engine});
+}
+
+std::vector<EngineReport> DifferentialReplay::run(unsigned int repeats)
+{
+    if (repeats == 0)
+        throw std::exception{};
+
+    // the legacy matcher would print every product's price range as it goes
+    bool printing = orderBook.getPrintPriceRanges();
+    orderBook.setPrintPriceRanges(false);
+
+    std::vector<EngineReport> reports;
+    SaleLog reference;
+    MatchEngine legacy = [](OrderBook &book, const std::string &product,
+                            const std::string &timestamp, std::vector<OrderBookEntry> &sales)
+    {
+        sales = book.matchAsksToBids(product, timestamp);
+    };
+    reports.push_back(replay("matchAsksToBids", legacy, repeats, reference));
+    for (auto const &engine : engines)
+    {
+        SaleLog log;
+        reports.push_back(replay(engine.first, engine.second, repeats, log));
+        compare(reference, log, reports.back());
+        reports.back().walletMatches = reports.back().wallet.hasSameBalances(reports[0].wallet);
+    }
+    orderBook.setPrintPriceRanges(printing);
+    return reports;
+}
+
+EngineReport DifferentialReplay::replay(const std::string& name,
+                                        const MatchEngine& engine,
+                                        unsigned int repeats,
+                                        SaleLog& log)
+{
+    EngineReport report;
+    report.name = name;
+    const std::vector<std::string> products = orderBook.getKnownProducts();
+
+    // the first pass is the one that is recorded and settled; any further
+    // passes only add to the timing
+    for (const std::string &timestamp : timestamps)
+    {
+        for (const std::string &product : products)
+        {
+            log.emplace_back();
+            engine(orderBook, product, timestamp, log.back());
+        }
+    }
+    std::vector<OrderBookEntry> sales;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < repeats; ++i)
+    {
+        for (const std::string &timestamp : timestamps)
+        {
+            for (const std::string &product : products)
+            {
+                sales.clear();
+                engine(orderBook, product, timestamp, sales);
+                report.sales += sales.size();
+                ++report.matches;
+            }
+        }
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report.wallet = startingWallet;
+    size_t next = 0;
+    for (const std::string &timestamp : timestamps)
+    {
+        for (size_t p = 0; p < products.size(); ++p, ++next)
+        {
+            for (const OrderBookEntry &sale : log[next])
+            {
+                if (sale.username == "simuser")
+                    report.wallet.processSale(sale);
+            }
+        }
+        report.wallet.releaseTimeframe(timestamp);
+    }
+    return report;
+}
+
+bool DifferentialReplay::sameSale(const OrderBookEntry& a, const OrderBookEntry& b)
+{
+    // engines must pick the same prices and amounts, not just close ones
+    return a.price == b.price &&
+           a.amount == b.amount &&
+           a.orderType == b.orderType &&
+           a.timestamp == b.timestamp &&
+           a.product == b.product &&
+           a.username == b.username &&
+           a.orderId == b.orderId;
+}
+
+std::string DifferentialReplay::describe(const OrderBookEntry& sale)
+{
+    std::ostringstream s;
+    s.precision(17);
+    s << (sale.orderType == OrderBookType::asksale ? "asksale " : "bidsale ") << sale.amount
+      << " @ " << sale.price << " " << sale.username;
+    if (sale.orderId != 0)
+        s << " #" << sale.orderId;
+    return s.str();
+}
+
+void DifferentialReplay::compare(const SaleLog& reference, const SaleLog& log, EngineReport& report) const
+{
+    const std::vector<std::string>& products = orderBook.getKnownProducts();
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        const std::vector<OrderBookEntry>& expected = reference[i];
+        const std::vector<OrderBookEntry>& actual = log[i];
+        size_t count = std::max(expected.size(), actual.size());
+        for (size_t j = 0; j < count; ++j)
+        {
+            bool haveExpected = j < expected.size();
+            bool haveActual = j < actual.size();
+            if (haveExpected && haveActual && sameSale(expected[j], actual[j]))
+                continue;
+            ++report.mismatchCount;
+            if (report.mismatches.size() >= maxMismatches)
+                continue;
+            SaleMismatch mismatch;
+            mismatch.timestamp = timestamps[i / products.size()];
+            mismatch.product = products[i % products.size()];
+            mismatch.index = j;
+            mismatch.expected = haveExpected ? describe(expected[j]) : "missing";
+            mismatch.actual = haveActual ? describe(actual[j]) : "missing";
+            report.mismatches.push_back(mismatch);
+        }
+    }
+}
+
+void DifferentialReplay::printReport(const std::vector<EngineReport>& reports)
+{
+    for (const EngineReport &report : reports)
+    {
+        double millis = report.seconds * 1000;
+        std::cout << "DifferentialReplay::printReport " << report.name << ": "
+                  << report.sales << " sales from " << report.matches << " matches in "
+                  << millis << " ms";
+        if (report.seconds > 0)
+            std::cout << " (" << report.matches / report.seconds << " matches/s, "
+                      << report.sales / report.seconds << " sales/s)";
+        std::cout << std::endl;
+        if (&report == &reports[0])
+            continue;
+        std::cout << "    " << (report.matchesReference() ? "identical to" : "DIFFERS from")
+                  << " matchAsksToBids: " << report.mismatchCount << " differing sales, wallet "
+                  << (report.walletMatches ? "matches" : "DOES NOT match") << std::endl;
+        for (const SaleMismatch &m : report.mismatches)
+        {
+            std::cout << "    " << m.timestamp << " " << m.product << " sale " << m.index
+                      << ": expected " << m.expected << ", got " << m.actual << std::endl;
+        }
+    }
+}
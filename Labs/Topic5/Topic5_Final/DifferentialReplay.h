@@ -0,0 +1,92 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Wallet.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+/** a matcher under test: append the sales for one product at one
+ * timestamp to sales, in the order matchAsksToBids would return them */
+typedef std::function<void(OrderBook& orderBook,
+                           const std::string& product,
+                           const std::string& timestamp,
+                           std::vector<OrderBookEntry>& sales)> MatchEngine;
+
+/** one place where an engine's sales differ from the reference */
+struct SaleMismatch
+{
+    std::string timestamp;
+    std::string product;
+    /** position within that product/timestamp's sales */
+    size_t index = 0;
+    /** what the reference and the engine produced there, or "missing" */
+    std::string expected;
+    std::string actual;
+};
+
+/** how one engine did over the whole replay */
+struct EngineReport
+{
+    std::string name;
+    unsigned long sales = 0;
+    /** product/timestamp pairs matched, over all repeats */
+    unsigned long matches = 0;
+    double seconds = 0;
+    /** simuser's wallet after settling this engine's sales */
+    Wallet wallet;
+    /** total number of differing sales, and the first few of them */
+    unsigned long mismatchCount = 0;
+    std::vector<SaleMismatch> mismatches;
+    bool walletMatches = true;
+
+    bool matchesReference() const { return mismatchCount == 0 && walletMatches; }
+};
+
+/** Replays every timeframe of a book through the legacy matchAsksToBids
+ * and through any number of other engines, and checks that each engine
+ * produces exactly the same sales in the same order, and leaves simuser's
+ * wallet in the same state, as the legacy matcher does.
+ *
+ * This is the gate for changes to matching: a new engine is added here
+ * and must report no differences before it replaces matchAsksToBids.
+ * Each engine is timed over the same product/timestamp pairs; the legacy
+ * matcher's price ranges are switched off while engines run so that the
+ * console does not dominate the timing.
+ */
+class DifferentialReplay
+{
+    public:
+        /** simuser's orders should already be in the book and reserved
+         * in startingWallet */
+        DifferentialReplay(OrderBook& orderBook, const Wallet& startingWallet);
+
+        /** add an engine to compare against matchAsksToBids */
+        void addEngine(std::string name, MatchEngine engine);
+
+        /** replay every timeframe repeats times through each engine.
+         * the first report is the legacy matcher */
+        std::vector<EngineReport> run(unsigned int repeats = 1);
+
+        static void printReport(const std::vector<EngineReport>& reports);
+
+        /** how many mismatches are kept in each report */
+        static const unsigned int maxMismatches = 10;
+
+    private:
+        /** every engine's sales for every product/timestamp, in replay order */
+        typedef std::vector<std::vector<OrderBookEntry>> SaleLog;
+
+        EngineReport replay(const std::string& name,
+                            const MatchEngine& engine,
+                            unsigned int repeats,
+                            SaleLog& log);
+        static bool sameSale(const OrderBookEntry& a, const OrderBookEntry& b);
+        static std::string describe(const OrderBookEntry& sale);
+        void compare(const SaleLog& reference, const SaleLog& log, EngineReport& report) const;
+
+        OrderBook& orderBook;
+        Wallet startingWallet;
+        std::vector<std::string> timestamps;
+        std::vector<std::pair<std::string, MatchEngine>> engines;
+};
@@ -0,0 +1,119 @@
+#include "FeedBook.h"
+
+FeedBook::FeedBook()
+{
+
+}
+
+bool FeedBook::apply(const FeedMessage& m)
+{
+    bool inSequence = m.sequence == lastSequence + 1;
+    if (!inSequence)
+    {
+        ++gaps;
+    }
+    lastSequence = m.sequence;
+
+    switch (m.type)
+    {
+        case FeedMessageType::product:
+            products[m.productId] = m.name;
+            break;
+        case FeedMessageType::add:
+        {
+            orders[m.orderId] = OpenOrder{m.productId, m.side, m.price, m.amount};
+            auto& levels = m.side == 'B' ? bidLevels[m.productId] : askLevels[m.productId];
+            levels[m.price] += m.amount;
+            break;
+        }
+        case FeedMessageType::execute:
+        case FeedMessageType::cancel:
+            reduce(m.orderId, m.amount);
+            break;
+        case FeedMessageType::trade:
+            ++trades;
+            break;
+    }
+    return inSequence;
+}
+
+void FeedBook::reduce(uint64_t orderId, double amount)
+{
+    auto it = orders.find(orderId);
+    if (it == orders.end())
+    {
+        return;
+    }
+    OpenOrder& order = it->second;
+    auto& levels = order.side == 'B' ? bidLevels[order.productId] : askLevels[order.productId];
+    auto level = levels.find(order.price);
+    if (level != levels.end())
+    {
+        level->second -= amount;
+        if (level->second <= 1e-12)
+            levels.erase(level);
+    }
+    order.amount -= amount;
+    if (order.amount <= 1e-12)
+    {
+        orders.erase(it);
+    }
+}
+
+size_t FeedBook::getOpenOrderCount() const
+{
+    return orders.size();
+}
+
+unsigned long FeedBook::getTradeCount() const
+{
+    return trades;
+}
+
+unsigned long FeedBook::getGapCount() const
+{
+    return gaps;
+}
+
+std::vector<std::string> FeedBook::getProducts() const
+{
+    std::vector<std::string> names;
+    for (auto const& pair : products)
+    {
+        names.push_back(pair.second);
+    }
+    return names;
+}
+
+uint64_t FeedBook::getLastSequence() const
+{
+    return lastSequence;
+}
+
+int FeedBook::findProduct(const std::string& product) const
+{
+    for (auto const& pair : products)
+    {
+        if (pair.second == product)
+            return pair.first;
+    }
+    return -1;
+}
+
+double FeedBook::getBestBid(const std::string& product) const
+{
+    int id = findProduct(product);
+    auto it = bidLevels.find(id);
+    if (id < 0 || it == bidLevels.end() || it->second.empty())
+        return 0;
+    return it->second.rbegin()->first;
+}
+
+double FeedBook::getBestAsk(const std::string& product) const
+{
+    int id = findProduct(product);
+    auto it = askLevels.find(id);
+    if (id < 0 || it == askLevels.end() || it->second.empty())
+        return 0;
+    return it->second.begin()->first;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "MarketDataFeed.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/** Rebuilds the order book from MarketDataFeed messages, one message at
+ * a time, keeping the total amount resting at each price level.
+ */
+class FeedBook
+{
+    public:
+        FeedBook();
+
+    /** apply one message. returns false if it skipped a sequence number */
+        bool apply(const FeedMessage& message);
+
+        size_t getOpenOrderCount() const;
+        unsigned long getTradeCount() const;
+        unsigned long getGapCount() const;
+    /** highest resting bid / lowest resting ask, or 0 if that side is empty */
+        double getBestBid(const std::string& product) const;
+        double getBestAsk(const std::string& product) const;
+    /** every product announced so far */
+        std::vector<std::string> getProducts() const;
+        uint64_t getLastSequence() const;
+
+    private:
+        struct OpenOrder
+        {
+            uint16_t productId;
+            char side;
+            double price;
+            double amount;
+        };
+    /** take amount off an open order and its price level, dropping
+     * either once it reaches zero */
+        void reduce(uint64_t orderId, double amount);
+        int findProduct(const std::string& product) const;
+
+        std::unordered_map<uint64_t, OpenOrder> orders;
+        std::map<uint16_t, std::string> products;
+    /** price -> total amount, per product */
+        std::map<uint16_t, std::map<double, double>> bidLevels;
+        std::map<uint16_t, std::map<double, double>> askLevels;
+        uint64_t lastSequence = 0;
+        unsigned long trades = 0;
+        unsigned long gaps = 0;
+};
@@ -0,0 +1,53 @@
+#include "FeedSink.h"
+#include <cerrno>
+#include <unistd.h>
+
+FileFeedSink::FileFeedSink(std::string filename)
+: file(filename, std::ios::binary | std::ios::trunc)
+{
+
+}
+
+bool FileFeedSink::isOpen()
+{
+    return file.is_open();
+}
+
+void FileFeedSink::write(const char* data, size_t size)
+{
+    file.write(data, size);
+    file.flush();
+}
+
+void MemoryFeedSink::write(const char* _data, size_t size)
+{
+    data.insert(data.end(), _data, _data + size);
+}
+
+const std::vector<char>& MemoryFeedSink::getData() const
+{
+    return data;
+}
+
+FdFeedSink::FdFeedSink(int _fd)
+: fd(_fd)
+{
+
+}
+
+void FdFeedSink::write(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // reader went away; nothing useful we can do with the rest
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/** Somewhere MarketDataFeed can send its encoded bytes. */
+class FeedSink
+{
+    public:
+        virtual ~FeedSink() {}
+    /** write all of data, in order */
+        virtual void write(const char* data, size_t size) = 0;
+};
+
+/** appends the feed to a file */
+class FileFeedSink : public FeedSink
+{
+    public:
+        FileFeedSink(std::string filename);
+        bool isOpen();
+        void write(const char* data, size_t size) override;
+
+    private:
+        std::ofstream file;
+};
+
+/** keeps the feed in memory, e.g. to decode it again straight away */
+class MemoryFeedSink : public FeedSink
+{
+    public:
+        void write(const char* data, size_t size) override;
+        const std::vector<char>& getData() const;
+
+    private:
+        std::vector<char> data;
+};
+
+/** writes the feed to an already-open file descriptor, e.g. a connected
+ * local socket or a pipe. does not close the descriptor */
+class FdFeedSink : public FeedSink
+{
+    public:
+        FdFeedSink(int fd);
+        void write(const char* data, size_t size) override;
+
+    private:
+        int fd;
+};
@@ -0,0 +1,136 @@
+#include "GatewayLoadGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+GatewayLoadGenerator::GatewayLoadGenerator(std::string _address, int _clients, int _ordersPerClient)
+: address(_address),
+  clients(_clients),
+  ordersPerClient(_ordersPerClient)
+{
+
+}
+
+int GatewayLoadGenerator::connectTo(std::string address)
+{
+    int fd;
+    if (!address.empty() && std::all_of(address.begin(), address.end(), [](unsigned char c) { return std::isdigit(c); }))
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(std::stoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        return fd;
+    }
+
+    sockaddr_un addr{};
+    if (address.size() >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, address.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void GatewayLoadGenerator::run()
+{
+    // one latency list per client so the threads never share anything
+    std::vector<std::vector<double>> latencies(clients);
+    std::atomic<unsigned long> rejected{0};
+    std::atomic<int> failedClients{0};
+
+    auto client = [this, &latencies, &rejected, &failedClients](int id)
+    {
+        int fd = connectTo(address);
+        if (fd < 0)
+        {
+            ++failedClients;
+            return;
+        }
+        std::vector<double>& times = latencies[id];
+        times.reserve(ordersPerClient);
+        char reply[256];
+        for (int i = 0; i < ordersPerClient; ++i)
+        {
+            // small, cheap bids well under the market so the wallet always covers them
+            std::string order = "BID,ETH/BTC,0.0" + std::to_string(10 + (id + i) % 90) + ",0.001\n";
+            auto start = std::chrono::steady_clock::now();
+            if (write(fd, order.data(), order.size()) != (ssize_t)order.size())
+                break;
+            size_t got = 0;
+            while (got == 0 || reply[got - 1] != '\n')
+            {
+                ssize_t n = read(fd, reply + got, sizeof(reply) - got);
+                if (n <= 0)
+                    break;
+                got += n;
+            }
+            if (got == 0)
+                break;
+            times.push_back(std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - start).count());
+            if (std::strncmp(reply, "OK", 2) != 0)
+                ++rejected;
+        }
+        close(fd);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(client, i);
+    }
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (std::vector<double>& times : latencies)
+    {
+        all.insert(all.end(), times.begin(), times.end());
+    }
+    std::sort(all.begin(), all.end());
+    if (all.empty())
+    {
+        std::cout << "GatewayLoadGenerator::run no replies from " << address << std::endl;
+        return;
+    }
+    auto percentile = [&all](double p)
+    {
+        return all[std::min(all.size() - 1, size_t(p * all.size()))];
+    };
+
+    std::cout << "GatewayLoadGenerator::run " << all.size() << " orders from "
+              << clients - failedClients << " clients in " << seconds << "s: "
+              << all.size() / seconds << " orders/s, " << rejected << " rejected" << std::endl;
+    std::cout << "round trip us: p50 " << percentile(0.5)
+              << " p99 " << percentile(0.99)
+              << " max " << all.back() << std::endl;
+}
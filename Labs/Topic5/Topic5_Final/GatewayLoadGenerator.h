@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+/** Loopback load generator for OrderGateway. Each client thread opens its
+ * own connection and sends orders one at a time, waiting for each reply,
+ * so we measure both orders/sec and round-trip latency.
+ */
+class GatewayLoadGenerator
+{
+    public:
+    /** address is a Unix socket path or a TCP port on 127.0.0.1 */
+        GatewayLoadGenerator(std::string address, int clients, int ordersPerClient);
+
+    /** run the clients and print throughput and latency percentiles */
+        void run();
+
+    /** connect to a gateway address, returning the socket or -1 */
+        static int connectTo(std::string address);
+
+    private:
+        std::string address;
+        int clients;
+        int ordersPerClient;
+};
@@ -0,0 +1,271 @@
+#include "MarketDataFeed.h"
+#include <cstdio>
+#include <cstring>
+
+// flush to the sink once this much has been buffered
+static const size_t flushThreshold = 64 * 1024;
+// u16 length + u8 type + u64 sequence + u64 timestamp
+static const size_t headerSize = 19;
+
+MarketDataFeed::MarketDataFeed(FeedSink& _sink)
+: sink(_sink)
+{
+    buffer.reserve(flushThreshold + 256);
+}
+
+MarketDataFeed::~MarketDataFeed()
+{
+    flush();
+}
+
+template <typename T>
+void MarketDataFeed::put(T value)
+{
+    // the wire format is little-endian, which is what we run on
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void MarketDataFeed::beginMessage(FeedMessageType type, uint64_t timestamp)
+{
+    messageStart = buffer.size();
+    put<uint16_t>(0); // length, filled in by endMessage
+    put<char>(static_cast<char>(type));
+    put<uint64_t>(++sequence);
+    put<uint64_t>(timestamp);
+}
+
+void MarketDataFeed::endMessage()
+{
+    uint16_t length = static_cast<uint16_t>(buffer.size() - messageStart);
+    std::memcpy(&buffer[messageStart], &length, sizeof(length));
+    if (buffer.size() >= flushThreshold)
+    {
+        flush();
+    }
+}
+
+uint16_t MarketDataFeed::getProductId(const std::string& product, uint64_t timestamp)
+{
+    auto it = productIds.find(product);
+    if (it != productIds.end())
+    {
+        return it->second;
+    }
+    uint16_t id = static_cast<uint16_t>(productIds.size());
+    productIds[product] = id;
+
+    beginMessage(FeedMessageType::product, timestamp);
+    put<uint16_t>(id);
+    put<uint8_t>(static_cast<uint8_t>(product.size()));
+    buffer.insert(buffer.end(), product.begin(), product.end());
+    endMessage();
+    return id;
+}
+
+uint64_t MarketDataFeed::micros(const std::string& timestamp)
+{
+    if (timestamp != lastTimestamp)
+    {
+        lastTimestamp = timestamp;
+        lastMicros = timestampToMicros(timestamp);
+    }
+    return lastMicros;
+}
+
+void MarketDataFeed::publishAdd(const OrderBookEntry& order)
+{
+    uint64_t time = micros(order.timestamp);
+    uint16_t productId = getProductId(order.product, time);
+    beginMessage(FeedMessageType::add, time);
+    put<uint64_t>(order.orderId);
+    put<uint16_t>(productId);
+    put<char>(order.orderType == OrderBookType::bid ? 'B' : 'S');
+    put<double>(order.price);
+    put<double>(order.amount);
+    endMessage();
+}
+
+void MarketDataFeed::publishExecute(const OrderBookEntry& order, double amount)
+{
+    beginMessage(FeedMessageType::execute, micros(order.timestamp));
+    put<uint64_t>(order.orderId);
+    put<double>(amount);
+    endMessage();
+}
+
+void MarketDataFeed::publishCancel(const OrderBookEntry& order, double amount)
+{
+    beginMessage(FeedMessageType::cancel, micros(order.timestamp));
+    put<uint64_t>(order.orderId);
+    put<double>(amount);
+    endMessage();
+}
+
+void MarketDataFeed::publishTrade(const OrderBookEntry& sale)
+{
+    uint64_t time = micros(sale.timestamp);
+    uint16_t productId = getProductId(sale.product, time);
+    beginMessage(FeedMessageType::trade, time);
+    put<uint16_t>(productId);
+    put<char>(sale.orderType == OrderBookType::bidsale ? 'B' : 'S');
+    put<double>(sale.price);
+    put<double>(sale.amount);
+    endMessage();
+}
+
+void MarketDataFeed::flush()
+{
+    if (!buffer.empty())
+    {
+        sink.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+uint64_t MarketDataFeed::getSequence() const
+{
+    return sequence;
+}
+
+template <typename T>
+static T get(const char*& p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+// the bytes after the header each type needs, not counting a product's name
+static size_t bodySize(FeedMessageType type)
+{
+    switch (type)
+    {
+        case FeedMessageType::product:
+            return 3;
+        case FeedMessageType::add:
+            return 27;
+        case FeedMessageType::execute:
+        case FeedMessageType::cancel:
+            return 16;
+        case FeedMessageType::trade:
+            return 19;
+    }
+    return 0;
+}
+
+size_t MarketDataFeed::decode(const char* data, size_t size, std::vector<FeedMessage>& messages)
+{
+    size_t used = 0;
+    while (size - used >= sizeof(uint16_t))
+    {
+        uint16_t length;
+        std::memcpy(&length, data + used, sizeof(length));
+        if (length < headerSize || size - used < length)
+        {
+            break;
+        }
+        const char* p = data + used + sizeof(uint16_t);
+        const char* end = data + used + length;
+        used += length;
+        FeedMessage m;
+        m.type = static_cast<FeedMessageType>(get<char>(p));
+        m.sequence = get<uint64_t>(p);
+        m.timestamp = get<uint64_t>(p);
+        // the length frames every message, so one we cannot read (an
+        // unknown type, or a body too short for its type) is skipped whole
+        size_t body = bodySize(m.type);
+        if (body == 0 || static_cast<size_t>(end - p) < body)
+        {
+            continue;
+        }
+        switch (m.type)
+        {
+            case FeedMessageType::product:
+            {
+                m.productId = get<uint16_t>(p);
+                uint8_t nameLength = get<uint8_t>(p);
+                if (end - p < nameLength)
+                {
+                    continue;
+                }
+                m.name.assign(p, nameLength);
+                break;
+            }
+            case FeedMessageType::add:
+                m.orderId = get<uint64_t>(p);
+                m.productId = get<uint16_t>(p);
+                m.side = get<char>(p);
+                m.price = get<double>(p);
+                m.amount = get<double>(p);
+                break;
+            case FeedMessageType::execute:
+                m.orderId = get<uint64_t>(p);
+                m.amount = get<double>(p);
+                break;
+            case FeedMessageType::cancel:
+                m.orderId = get<uint64_t>(p);
+                m.amount = get<double>(p);
+                break;
+            case FeedMessageType::trade:
+                m.productId = get<uint16_t>(p);
+                m.side = get<char>(p);
+                m.price = get<double>(p);
+                m.amount = get<double>(p);
+                break;
+        }
+        messages.push_back(m);
+    }
+    return used;
+}
+
+uint64_t MarketDataFeed::timestampToMicros(const std::string& timestamp)
+{
+    int year = 1970, month = 1, day = 1, hour = 0, minute = 0, second = 0;
+    char fraction[7] = "";
+    std::sscanf(timestamp.c_str(), "%d/%d/%d %d:%d:%d.%6[0-9]",
+                &year, &month, &day, &hour, &minute, &second, fraction);
+
+    // days since 1970-01-01 (Howard Hinnant's days_from_civil)
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = int64_t(era) * 146097 + doe - 719468;
+
+    // "8845" means 884500 microseconds; the unread digits are all '\0'
+    uint64_t micros = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        micros = micros * 10 + (fraction[i] == '\0' ? 0 : fraction[i] - '0');
+    }
+
+    return uint64_t(((days * 24 + hour) * 60 + minute) * 60 + second) * 1000000 + micros;
+}
+
+std::string MarketDataFeed::microsToTimestamp(uint64_t micros)
+{
+    int64_t seconds = micros / 1000000;
+    int64_t days = seconds / 86400;
+    int secondOfDay = int(seconds % 86400);
+
+    // civil date from days since 1970-01-01 (Howard Hinnant's civil_from_days)
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = int(days - era * 146097);
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int day = doy - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = int(yoe + era * 400 + (month <= 2));
+
+    char text[64];
+    std::snprintf(text, sizeof(text), "%04d/%02d/%02d %02d:%02d:%02d.%06d",
+                  year, month, day, secondOfDay / 3600, secondOfDay / 60 % 60,
+                  secondOfDay % 60, int(micros % 1000000));
+    return text;
+}
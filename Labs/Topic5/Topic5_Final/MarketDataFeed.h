@@ -0,0 +1,93 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "FeedSink.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/** The kinds of message on the feed. The values are what goes on the wire. */
+enum class FeedMessageType : char
+{
+    product = 'R',
+    add = 'A',
+    execute = 'E',
+    cancel = 'X',
+    trade = 'P'
+};
+
+/** One decoded feed message. Only the fields for its type are filled in.
+ *
+ * Wire format (little-endian, no padding). Every message starts with
+ *   u16 length (of the whole message), u8 type, u64 sequence, u64 timestamp
+ * where timestamp is microseconds since the Unix epoch. Then:
+ *   product: u16 productId, u8 nameLength, name
+ *   add:     u64 orderId, u16 productId, u8 side ('B' or 'S'), f64 price, f64 amount
+ *   execute: u64 orderId, f64 amount (how much of the order was filled)
+ *   cancel:  u64 orderId, f64 amount (what was left of the order)
+ *   trade:   u16 productId, u8 side (of the simuser's order, else 'S'), f64 price, f64 amount
+ */
+struct FeedMessage
+{
+    FeedMessageType type;
+    uint64_t sequence = 0;
+    uint64_t timestamp = 0;
+    uint64_t orderId = 0;
+    uint16_t productId = 0;
+    char side = 0;
+    double price = 0;
+    double amount = 0;
+    /** product messages only */
+    std::string name;
+};
+
+/** Encodes order book events into a compact binary stream, in the spirit
+ * of ITCH, so other tools can rebuild the book without scraping std::cout.
+ * Messages are buffered and handed to the sink on flush() or when the
+ * buffer fills up.
+ */
+class MarketDataFeed
+{
+    public:
+        MarketDataFeed(FeedSink& sink);
+        ~MarketDataFeed();
+
+        void publishAdd(const OrderBookEntry& order);
+        void publishExecute(const OrderBookEntry& order, double amount);
+    /** the rest of an order is gone, e.g. its timeframe has been matched */
+        void publishCancel(const OrderBookEntry& order, double amount);
+        void publishTrade(const OrderBookEntry& sale);
+
+    /** send everything buffered so far to the sink */
+        void flush();
+
+        uint64_t getSequence() const;
+
+    /** decode whole messages from data into messages and return the number
+     * of bytes used. a partial message at the end is left for next time,
+     * and one of an unknown type or too short for its type is skipped */
+        static size_t decode(const char* data, size_t size, std::vector<FeedMessage>& messages);
+    /** "2020/03/17 17:01:24.884492" -> microseconds since the Unix epoch */
+        static uint64_t timestampToMicros(const std::string& timestamp);
+    /** the reverse of timestampToMicros, always with six fraction digits */
+        static std::string microsToTimestamp(uint64_t micros);
+
+    private:
+    /** look up the id for a product, announcing it first if it is new */
+        uint16_t getProductId(const std::string& product, uint64_t timestamp);
+    /** timestampToMicros, remembering the last one since orders arrive in runs */
+        uint64_t micros(const std::string& timestamp);
+        void beginMessage(FeedMessageType type, uint64_t timestamp);
+        void endMessage();
+        template <typename T>
+        void put(T value);
+
+        FeedSink& sink;
+        std::vector<char> buffer;
+        size_t messageStart = 0;
+        uint64_t sequence = 0;
+        std::map<std::string, uint16_t> productIds;
+        std::string lastTimestamp;
+        uint64_t lastMicros = 0;
+};
@@ -0,0 +1,230 @@
+#include "MarketSimulator.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+MarketSimulator::MarketSimulator(OrderBook& _orderBook, const SimulationConfig& _config, const Wallet& startingWallet)
+: orderBook(_orderBook),
+  config(_config),
+  wallets(std::max(1, _config.wallets), startingWallet),
+  products(_orderBook.getKnownProducts()),
+  quotes(products.size())
+{
+    auto addAgents = [this](AgentKind kind, int count, int orders)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            int id = agents.size();
+            agents.push_back(Agent{kind, "agent" + std::to_string(id), id % int(wallets.size()), orders,
+                                   std::mt19937{config.seed + id}});
+        }
+    };
+    addAgents(AgentKind::marketMaker, config.marketMakers, config.makerOrders);
+    addAgents(AgentKind::noiseTrader, config.noiseTraders, config.noiseOrders);
+    addAgents(AgentKind::momentumTrader, config.momentumTraders, config.momentumOrders);
+}
+
+SimulationResult MarketSimulator::run()
+{
+    SimulationResult result;
+    unsigned int threads = config.threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<size_t>(threads, std::max<size_t>(1, agents.size()));
+
+    // agents add orders as we go, so take the timestamps first
+    std::vector<std::string> timestamps;
+    for (const OrderSpan& frame : orderBook.getTimeframes())
+    {
+        timestamps.push_back(frame[0].timestamp);
+    }
+    result.timeframes = timestamps.size();
+
+    for (const std::string& timestamp : timestamps)
+    {
+        quoteTimeframe(timestamp);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        size_t chunk = (agents.size() + threads - 1) / threads;
+        for (unsigned int t = 0; t < threads; ++t)
+        {
+            size_t first = t * chunk;
+            size_t last = std::min(agents.size(), first + chunk);
+            if (first < last)
+            {
+                workers.emplace_back(&MarketSimulator::runAgents, this, first, last, std::cref(timestamp));
+            }
+        }
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        auto submitted = std::chrono::steady_clock::now();
+
+        result.fills += matchTimeframe(timestamp);
+        auto matched = std::chrono::steady_clock::now();
+
+        result.submitSeconds += std::chrono::duration<double>(submitted - start).count();
+        result.matchSeconds += std::chrono::duration<double>(matched - submitted).count();
+    }
+
+    result.ordersPlaced = ordersPlaced;
+    result.ordersRejected = ordersRejected;
+    result.lockWaitSeconds = lockWaitNanos * 1e-9;
+    return result;
+}
+
+void MarketSimulator::quoteTimeframe(const std::string& timestamp)
+{
+    std::vector<ProductQuote> latest(products.size());
+    std::vector<unsigned long> counts(products.size(), 0);
+    for (const OrderBookEntry& e : orderBook.getOrdersAt(timestamp))
+    {
+        auto it = std::lower_bound(products.begin(), products.end(), e.product);
+        if (it == products.end() || *it != e.product || e.username != "dataset")
+            continue;
+        ProductQuote& quote = latest[it - products.begin()];
+        if (e.orderType == OrderBookType::bid && e.price > quote.bestBid)
+            quote.bestBid = e.price;
+        if (e.orderType == OrderBookType::ask && (quote.bestAsk == 0 || e.price < quote.bestAsk))
+            quote.bestAsk = e.price;
+        quote.meanAmount += e.amount;
+        ++counts[it - products.begin()];
+    }
+    for (size_t p = 0; p < products.size(); ++p)
+    {
+        ProductQuote& quote = latest[p];
+        if (quote.bestBid > 0 && quote.bestAsk > 0)
+            quote.mid = (quote.bestBid + quote.bestAsk) / 2;
+        if (counts[p] > 0)
+            quote.meanAmount /= counts[p];
+        quote.previousMid = quotes[p].mid;
+    }
+    quotes = latest;
+}
+
+void MarketSimulator::runAgents(size_t first, size_t last, const std::string& timestamp)
+{
+    std::uniform_real_distribution<double> unit{0, 1};
+    std::normal_distribution<double> noise{0, 0.002};
+    for (size_t i = first; i < last; ++i)
+    {
+        Agent& agent = agents[i];
+        for (int n = 0; n < agent.orders; ++n)
+        {
+            size_t p = agent.rng() % products.size();
+            const ProductQuote& quote = quotes[p];
+            if (quote.mid == 0)
+                continue;
+            double amount = quote.meanAmount * (0.05 + 0.2 * unit(agent.rng));
+            switch (agent.kind)
+            {
+                case AgentKind::marketMaker:
+                    // quote both sides just inside the dataset's spread
+                    placeOrder(agent, products[p], quote.mid * 0.999, amount, OrderBookType::bid, timestamp);
+                    placeOrder(agent, products[p], quote.mid * 1.001, amount, OrderBookType::ask, timestamp);
+                    break;
+                case AgentKind::noiseTrader:
+                    placeOrder(agent, products[p], quote.mid * (1 + noise(agent.rng)), amount,
+                               unit(agent.rng) < 0.5 ? OrderBookType::bid : OrderBookType::ask, timestamp);
+                    break;
+                case AgentKind::momentumTrader:
+                    // cross the spread in the direction the mid last moved
+                    if (quote.previousMid == 0 || quote.mid == quote.previousMid)
+                        break;
+                    if (quote.mid > quote.previousMid)
+                        placeOrder(agent, products[p], quote.bestAsk, amount, OrderBookType::bid, timestamp);
+                    else
+                        placeOrder(agent, products[p], quote.bestBid, amount, OrderBookType::ask, timestamp);
+                    break;
+            }
+        }
+    }
+}
+
+void MarketSimulator::placeOrder(Agent& agent, const std::string& product, double price, double amount,
+                                 OrderBookType type, const std::string& timestamp)
+{
+    OrderBookEntry order{price, amount, timestamp, product, type, agent.username};
+
+    auto waitStart = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock{bookMutex};
+    lockWaitNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - waitStart).count();
+    order.orderId = orderBook.newOrderId();
+    lock.unlock();
+
+    if (!wallets[agent.wallet].reserveOrder(order))
+    {
+        ++ordersRejected;
+        return;
+    }
+
+    waitStart = std::chrono::steady_clock::now();
+    lock.lock();
+    lockWaitNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - waitStart).count();
+    orderBook.insertOrder(order);
+    orderWallets[order.orderId] = agent.wallet;
+    ++ordersPlaced;
+}
+
+unsigned long MarketSimulator::matchTimeframe(const std::string& timestamp)
+{
+    unsigned long fills = 0;
+    for (const std::string& product : products)
+    {
+        std::pmr::vector<Fill> matched{&arena};
+        orderBook.matchProduct(product, timestamp, arena, matched);
+        fills += matched.size();
+        for (const Fill& fill : matched)
+        {
+            auto askWallet = orderWallets.find(fill.ask->orderId);
+            if (askWallet != orderWallets.end())
+            {
+                OrderBookEntry sale{fill.price, fill.amount, timestamp, product,
+                                    OrderBookType::asksale, fill.ask->username};
+                sale.orderId = fill.ask->orderId;
+                wallets[askWallet->second].processSale(sale);
+            }
+            auto bidWallet = orderWallets.find(fill.bid->orderId);
+            if (bidWallet != orderWallets.end())
+            {
+                OrderBookEntry sale{fill.price, fill.amount, timestamp, product,
+                                    OrderBookType::bidsale, fill.bid->username};
+                sale.orderId = fill.bid->orderId;
+                wallets[bidWallet->second].processSale(sale);
+            }
+        }
+    }
+    arena.reset();
+
+    // whatever did not fill can no longer fill
+    for (Wallet& wallet : wallets)
+    {
+        wallet.releaseTimeframe(timestamp);
+    }
+    orderWallets.clear();
+    return fills;
+}
+
+void MarketSimulator::printResult(const SimulationResult& result) const
+{
+    std::cout << "MarketSimulator::run " << agents.size() << " agents, " << wallets.size() << " wallets, "
+              << result.timeframes << " timeframes" << std::endl;
+    std::cout << "MarketSimulator::run " << result.ordersPlaced << " orders placed, "
+              << result.ordersRejected << " rejected, " << result.fills << " fills" << std::endl;
+    std::cout << "MarketSimulator::run submitting took " << result.submitSeconds << " s ("
+              << (result.submitSeconds > 0 ? (result.ordersPlaced + result.ordersRejected) / result.submitSeconds : 0)
+              << " orders/s, " << result.lockWaitSeconds << " s waiting for the book), matching took "
+              << result.matchSeconds << " s" << std::endl;
+}
+
+const std::vector<Wallet>& MarketSimulator::getWallets() const
+{
+    return wallets;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "MatchArena.h"
+#include "Wallet.h"
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** how many agents of each kind to run and how many orders each one
+ * places per timeframe */
+struct SimulationConfig
+{
+    int marketMakers = 1000;
+    int noiseTraders = 2000;
+    int momentumTraders = 1000;
+    int makerOrders = 2;
+    int noiseOrders = 1;
+    int momentumOrders = 1;
+    /** agents share this many wallets, round robin, so they contend on them */
+    int wallets = 64;
+    /** threads submitting orders. 0 means use all cores */
+    unsigned int threads = 0;
+    unsigned int seed = 1;
+};
+
+/** what a simulation run did */
+struct SimulationResult
+{
+    size_t timeframes = 0;
+    unsigned long ordersPlaced = 0;
+    /** orders dropped because the wallet could not cover them */
+    unsigned long ordersRejected = 0;
+    unsigned long fills = 0;
+    double submitSeconds = 0;
+    double matchSeconds = 0;
+    /** total time agents spent waiting for the order book lock */
+    double lockWaitSeconds = 0;
+};
+
+/** Runs a population of simple trading agents against an OrderBook.
+ *
+ * For each timeframe of the book, the agents are split across threads and
+ * place orders at that timestamp, reserving funds in their wallet and
+ * inserting into the book under one lock, as orders reaching a single
+ * matching engine would. Then the timeframe is matched and every fill is
+ * settled into the wallets of the agents on each side.
+ */
+class MarketSimulator
+{
+    public:
+        MarketSimulator(OrderBook& orderBook, const SimulationConfig& config, const Wallet& startingWallet);
+
+        SimulationResult run();
+        void printResult(const SimulationResult& result) const;
+        const std::vector<Wallet>& getWallets() const;
+
+    private:
+        enum class AgentKind { marketMaker, noiseTrader, momentumTrader };
+
+        struct Agent
+        {
+            AgentKind kind;
+            std::string username;
+            int wallet;
+            int orders;
+            std::mt19937 rng;
+        };
+
+        /** what agents know about one product in the current timeframe */
+        struct ProductQuote
+        {
+            double bestBid = 0;
+            double bestAsk = 0;
+            double mid = 0;
+            /** mid in the previous timeframe, 0 if there was none */
+            double previousMid = 0;
+            double meanAmount = 0;
+        };
+
+        /** read the dataset's top of book for each product at timestamp */
+        void quoteTimeframe(const std::string& timestamp);
+        void runAgents(size_t first, size_t last, const std::string& timestamp);
+        void placeOrder(Agent& agent, const std::string& product, double price, double amount,
+                        OrderBookType type, const std::string& timestamp);
+        /** match every product at timestamp and settle the fills */
+        unsigned long matchTimeframe(const std::string& timestamp);
+
+        OrderBook& orderBook;
+        SimulationConfig config;
+        std::vector<Agent> agents;
+        std::vector<Wallet> wallets;
+        std::vector<std::string> products;
+        std::vector<ProductQuote> quotes;
+
+        std::mutex bookMutex;
+        /** which wallet placed each order */
+        std::unordered_map<unsigned long, int> orderWallets;
+        MatchArena arena;
+
+        std::atomic<unsigned long> ordersPlaced{0};
+        std::atomic<unsigned long> ordersRejected{0};
+        std::atomic<unsigned long> lockWaitNanos{0};
+};
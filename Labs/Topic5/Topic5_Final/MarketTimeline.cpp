@@ -0,0 +1,70 @@
+#include "MarketTimeline.h"
+#include <algorithm>
+#include <map>
+
+const ProductFrame* Timeframe::findProduct(const std::string& product) const
+{
+    for (const ProductFrame& p : products)
+    {
+        if (p.product == product)
+            return &p;
+    }
+    return nullptr;
+}
+
+MarketTimeline::MarketTimeline(const std::vector<OrderBookEntry>& orders)
+{
+    size_t start = 0;
+    while (start < orders.size())
+    {
+        // find the end of this timestamp's run of orders
+        size_t end = start;
+        while (end < orders.size() && orders[end].timestamp == orders[start].timestamp)
+        {
+            ++end;
+        }
+
+        Timeframe frame;
+        frame.timestamp = orders[start].timestamp;
+        std::map<std::string, ProductFrame> byProduct;
+        for (size_t i = start; i < end; ++i)
+        {
+            const OrderBookEntry& e = orders[i];
+            ProductFrame& p = byProduct[e.product];
+            p.product = e.product;
+            if (e.orderType == OrderBookType::ask)
+                p.asks.push_back(e);
+            if (e.orderType == OrderBookType::bid)
+                p.bids.push_back(e);
+        }
+        for (auto& pair : byProduct)
+        {
+            ProductFrame& p = pair.second;
+            std::stable_sort(p.asks.begin(), p.asks.end(), OrderBookEntry::compareByPriceAsc);
+            std::stable_sort(p.bids.begin(), p.bids.end(), OrderBookEntry::compareByPriceDesc);
+            frame.products.push_back(std::move(p));
+        }
+        timeframes.push_back(std::move(frame));
+        start = end;
+    }
+}
+
+const std::vector<Timeframe>& MarketTimeline::getTimeframes() const
+{
+    return timeframes;
+}
+
+std::vector<std::string> MarketTimeline::getKnownProducts() const
+{
+    std::vector<std::string> products;
+    for (const Timeframe& frame : timeframes)
+    {
+        for (const ProductFrame& p : frame.products)
+        {
+            if (std::find(products.begin(), products.end(), p.product) == products.end())
+                products.push_back(p.product);
+        }
+    }
+    std::sort(products.begin(), products.end());
+    return products;
+}
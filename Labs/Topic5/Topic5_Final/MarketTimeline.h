@@ -0,0 +1,43 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <string>
+#include <vector>
+
+/** the dataset orders for one product in one timeframe,
+ * each side sorted best price first */
+struct ProductFrame
+{
+    std::string product;
+    /** sorted low to high */
+    std::vector<OrderBookEntry> asks;
+    /** sorted high to low */
+    std::vector<OrderBookEntry> bids;
+};
+
+/** every product's orders at one timestamp */
+struct Timeframe
+{
+    std::string timestamp;
+    std::vector<ProductFrame> products;
+
+    /** returns the frame for this product, or nullptr if it had no orders */
+    const ProductFrame* findProduct(const std::string& product) const;
+};
+
+/** The order book history grouped into timeframes, built once and then
+ * only read, so any number of threads can share one timeline.
+ */
+class MarketTimeline
+{
+    public:
+    /** group orders (which must be in timestamp order) by timestamp and product */
+        MarketTimeline(const std::vector<OrderBookEntry>& orders);
+
+        const std::vector<Timeframe>& getTimeframes() const;
+    /** return every product seen in any timeframe, sorted by name */
+        std::vector<std::string> getKnownProducts() const;
+
+    private:
+        std::vector<Timeframe> timeframes;
+};
@@ -0,0 +1,75 @@
+#include "MatchArena.h"
+#include <algorithm>
+
+MatchArena::MatchArena(size_t initialSize)
+: block(new char[initialSize]),
+  capacity(initialSize)
+{
+    ++heapAllocations;
+    // room for the overflow list itself, so pushing to it does not count
+    overflow.reserve(16);
+}
+
+void MatchArena::reset()
+{
+    peakBytes = std::max(peakBytes, getBytesUsed());
+    if (!overflow.empty())
+    {
+        // grow so the whole of the last timeframe would have fitted, with room to spare
+        size_t needed = (offset + overflowBytes) * 2;
+        overflow.clear();
+        overflowBytes = 0;
+        block.reset(new char[needed]);
+        capacity = needed;
+        ++heapAllocations;
+    }
+    offset = 0;
+}
+
+void* MatchArena::do_allocate(size_t bytes, size_t alignment)
+{
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= capacity)
+    {
+        offset = start + bytes;
+        return block.get() + start;
+    }
+
+    // full: borrow from the heap until the next reset
+    overflow.emplace_back(new char[bytes + alignment]);
+    overflowBytes += bytes + alignment;
+    ++heapAllocations;
+    char* p = overflow.back().get();
+    size_t misalign = reinterpret_cast<size_t>(p) & (alignment - 1);
+    return misalign == 0 ? p : p + (alignment - misalign);
+}
+
+void MatchArena::do_deallocate(void*, size_t, size_t)
+{
+    // monotonic: everything goes at once in reset()
+}
+
+bool MatchArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+unsigned long MatchArena::getHeapAllocations() const
+{
+    return heapAllocations;
+}
+
+size_t MatchArena::getBytesUsed() const
+{
+    return offset + overflowBytes;
+}
+
+size_t MatchArena::getPeakBytesUsed() const
+{
+    return peakBytes;
+}
+
+size_t MatchArena::getCapacity() const
+{
+    return capacity;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/** A monotonic memory resource for one timeframe's matching scratch data.
+ * Allocation just bumps an offset into one block and deallocation does
+ * nothing; reset() rewinds the offset once the timeframe is settled.
+ * If a timeframe needs more than the block holds, the extra comes from
+ * the heap and the block is regrown to fit at the next reset, so after a
+ * few timeframes the arena itself stops touching the heap.
+ * getHeapAllocations() counts only the arena's own trips to the heap;
+ * anything allocated around it, such as the sales built from the fills
+ * and their strings, is not counted.
+ */
+class MatchArena : public std::pmr::memory_resource
+{
+    public:
+        MatchArena(size_t initialSize = 64 * 1024);
+
+    /** forget everything allocated since the last reset. O(1) unless the
+     * last timeframe overflowed, in which case the block is regrown once */
+        void reset();
+
+    /** how many times the arena has had to allocate from the heap.
+     * allocations that do not go through the arena are not counted */
+        unsigned long getHeapAllocations() const;
+    /** bytes handed out since the last reset */
+        size_t getBytesUsed() const;
+    /** the most bytes any one timeframe used, as of the last reset */
+        size_t getPeakBytesUsed() const;
+        size_t getCapacity() const;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        std::unique_ptr<char[]> block;
+        size_t capacity;
+        size_t offset = 0;
+    /** heap blocks taken this timeframe because the main block was full */
+        std::vector<std::unique_ptr<char[]>> overflow;
+        size_t overflowBytes = 0;
+        unsigned long heapAllocations = 0;
+        size_t peakBytes = 0;
+};
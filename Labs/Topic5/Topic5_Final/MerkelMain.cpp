@@ -3,6 +3,10 @@
 #include <vector>
 #include "OrderBookEntry.h"
 #include "CSVReader.h"
+#include "Profiler.h"
+#include "MarketDataFeed.h"
+#include <fstream>
+#include <sstream>
 
 MerkelMain::MerkelMain()
 {
@@ -14,6 +18,9 @@ void MerkelMain::init()
     currentTime = orderBook.getEarliestTime();
 
     wallet.insertCurrency("BTC", 10);
+    markToMarket();
+    timers = TimingWheel{simulationMicros()};
+    timers.schedule(simulationMicros() + snapshotSeconds * 1000000ull, statsSnapshot, 0);
 
     while (true)
     {
@@ -37,6 +44,8 @@ void MerkelMain::printMenu()
     std::cout << "5: Print wallet " << std::endl;
     // 6 continue
     std::cout << "6: Continue " << std::endl;
+    // 7 print where the time has gone
+    std::cout << "7: Print stats " << std::endl;
 
     std::cout << "============== " << std::endl;
 
@@ -53,8 +62,8 @@ void MerkelMain::printMarketStats()
     for (std::string const &p : orderBook.getKnownProducts())
     {
         std::cout << "Product: " << p << std::endl;
-        std::vector<OrderBookEntry> entries = orderBook.getOrders(OrderBookType::ask,
-                                                                  p, currentTime);
+        OrderView entries = orderBook.getOrderView(OrderBookType::ask,
+                                                   p, currentTime);
         std::cout << "Asks seen: " << entries.size() << std::endl;
         std::cout << "Max ask: " << OrderBook::getHighPrice(entries) << std::endl;
         std::cout << "Min ask: " << OrderBook::getLowPrice(entries) << std::endl;
@@ -64,11 +73,13 @@ void MerkelMain::printMarketStats()
 void MerkelMain::enterAsk()
 {
     std::cout << "Make an ask - enter the amount: product,price, amount, eg  ETH/BTC,200,0.5" << std::endl;
+    std::cout << "add ,market ,ioc or ,fok to trade straight away, eg  ETH/BTC,200,0.5,ioc" << std::endl;
+    std::cout << "or ,limit,seconds to keep it working that long, eg  ETH/BTC,200,0.5,limit,30" << std::endl;
     std::string input;
     std::getline(std::cin, input);
 
     std::vector<std::string> tokens = CSVReader::tokenise(input, ',');
-    if (tokens.size() != 3)
+    if (tokens.size() < 3 || tokens.size() > 5)
     {
         std::cout << "MerkelMain::enterAsk Bad input! " << input << std::endl;
     }
@@ -83,16 +94,19 @@ void MerkelMain::enterAsk()
                 tokens[0],
                 OrderBookType::ask);
             obe.username = "simuser";
-
-            if (wallet.canFulfilOrder(obe))
+            obe.orderId = orderBook.newOrderId();
+            if (tokens.size() >= 4)
             {
-                std::cout << "Wallet looks good." << std::endl;
-                orderBook.insertOrder(obe);
+                obe.execution = OrderBookEntry::stringToOrderExecution(tokens[3]);
             }
-            else
+            double goodForSeconds = 0;
+            if (tokens.size() == 5)
             {
-                std::cout << "Wallet has insufficient funds." << std::endl;
+                goodForSeconds = std::stod(tokens[4]);
+                if (goodForSeconds <= 0 || obe.execution != OrderExecution::limit)
+                    throw std::exception{};
             }
+            placeOrder(obe, goodForSeconds);
         }
         catch (const std::exception &e)
         {
@@ -106,11 +120,13 @@ void MerkelMain::enterAsk()
 void MerkelMain::enterBid()
 {
     std::cout << "Make a bid - enter the amount: product,price, amount, eg  ETH/BTC,200,0.5" << std::endl;
+    std::cout << "add ,market ,ioc or ,fok to trade straight away, eg  ETH/BTC,200,0.5,ioc" << std::endl;
+    std::cout << "or ,limit,seconds to keep it working that long, eg  ETH/BTC,200,0.5,limit,30" << std::endl;
     std::string input;
     std::getline(std::cin, input);
 
     std::vector<std::string> tokens = CSVReader::tokenise(input, ',');
-    if (tokens.size() != 3)
+    if (tokens.size() < 3 || tokens.size() > 5)
     {
         std::cout << "MerkelMain::enterBid: bad input! " << input << std::endl;
     }
@@ -125,15 +141,19 @@ void MerkelMain::enterBid()
                 tokens[0],
                 OrderBookType::bid);
             obe.username = "simuser";
-            if (wallet.canFulfilOrder(obe))
+            obe.orderId = orderBook.newOrderId();
+            if (tokens.size() >= 4)
             {
-                std::cout << "Wallet looks good." << std::endl;
-                orderBook.insertOrder(obe);
+                obe.execution = OrderBookEntry::stringToOrderExecution(tokens[3]);
             }
-            else
+            double goodForSeconds = 0;
+            if (tokens.size() == 5)
             {
-                std::cout << "Wallet has insufficient funds." << std::endl;
+                goodForSeconds = std::stod(tokens[4]);
+                if (goodForSeconds <= 0 || obe.execution != OrderExecution::limit)
+                    throw std::exception{};
             }
+            placeOrder(obe, goodForSeconds);
         }
         catch (const std::exception &e)
         {
@@ -144,6 +164,49 @@ void MerkelMain::enterBid()
     std::cout << "You typed: " << input << std::endl;
 }
 
+void MerkelMain::placeOrder(OrderBookEntry &obe, double goodForSeconds)
+{
+    if (obe.execution == OrderExecution::limit)
+    {
+        if (wallet.reserveOrder(obe))
+        {
+            std::cout << "Wallet looks good." << std::endl;
+            orderBook.insertOrder(obe);
+            if (goodForSeconds > 0)
+            {
+                uint64_t expiry = simulationMicros() + uint64_t(goodForSeconds * 1000000);
+                workingOrders.emplace(obe.orderId, WorkingOrder{obe, timers.schedule(expiry, orderExpiry, obe.orderId)});
+                std::cout << "Working for " << goodForSeconds << " seconds" << std::endl;
+            }
+        }
+        else
+        {
+            std::cout << "Wallet has insufficient funds." << std::endl;
+        }
+        return;
+    }
+
+    if (obe.execution == OrderExecution::market && obe.orderType == OrderBookType::bid)
+    {
+        // a market bid can cost at most the dearest ask, so hold that much
+        obe.price = OrderBook::getHighPrice(orderBook.getOrderView(OrderBookType::ask, obe.product, currentTime));
+    }
+    if (!wallet.reserveOrder(obe))
+    {
+        std::cout << "Wallet has insufficient funds." << std::endl;
+        return;
+    }
+    std::vector<OrderBookEntry> sales;
+    double filled = orderBook.executeImmediate(obe, arena, sales);
+    for (const OrderBookEntry &sale : sales)
+    {
+        std::cout << "Sale price: " << sale.price << " amount " << sale.amount << std::endl;
+        wallet.processSale(sale);
+    }
+    wallet.releaseOrder(obe.orderId);
+    std::cout << "Filled " << filled << ", " << obe.amount << " cancelled" << std::endl;
+}
+
 void MerkelMain::printWallet()
 {
     std::cout << wallet.toString() << std::endl;
@@ -152,30 +215,165 @@ void MerkelMain::printWallet()
 void MerkelMain::gotoNextTimeframe()
 {
     std::cout << "Going to next time frame. " << std::endl;
-    for (std::string &p : orderBook.getKnownProducts())
+    for (std::string const &p : orderBook.getKnownProducts())
     {
-        std::cout << "matching " << p << std::endl;
-        std::vector<OrderBookEntry> sales = orderBook.matchAsksToBids(p, currentTime);
-        std::cout << "Sales: " << sales.size() << std::endl;
-        for (OrderBookEntry &sale : sales)
         {
-            std::cout << "Sale price: " << sale.price << " amount " << sale.amount << std::endl;
-            if (sale.username == "simuser")
+            PROFILE_SCOPE(print);
+            std::cout << "matching " << p << std::endl;
+        }
+        std::pmr::vector<Fill> fills{&arena};
+        {
+            PROFILE_SCOPE(match);
+            orderBook.matchProduct(p, currentTime, arena, fills);
+            PROFILE_ITEMS(match, fills.size());
+        }
+        {
+            PROFILE_SCOPE(print);
+            std::cout << "Sales: " << fills.size() << std::endl;
+            for (const Fill &fill : fills)
+            {
+                std::cout << "Sale price: " << fill.price << " amount " << fill.amount << std::endl;
+            }
+        }
+        PROFILE_SCOPE(settle);
+        for (const Fill &fill : fills)
+        {
+            if (fill.ask->username == "simuser" || fill.bid->username == "simuser")
             {
                 // update the wallet
+                OrderBookEntry sale = fill.toSale();
                 wallet.processSale(sale);
-                
+                auto working = workingOrders.find(sale.orderId);
+                if (working != workingOrders.end())
+                {
+                    working->second.order.amount -= sale.amount;
+                }
+                PROFILE_ITEMS(settle, 1);
             }
         }
     }
-    currentTime = orderBook.getNextTime(currentTime);
+    arena.reset();
+    std::string nextTime;
+    {
+        PROFILE_SCOPE(index);
+        nextTime = orderBook.getNextTime(currentTime);
+    }
+    {
+        PROFILE_SCOPE(settle);
+        advanceClock(nextTime);
+        carryOverOrders(nextTime);
+        // other unfilled orders cannot match in later timeframes, so free their funds
+        wallet.releaseTimeframe(currentTime);
+    }
+    currentTime = nextTime;
+    PROFILE_SCOPE(mark);
+    markToMarket();
+}
+
+uint64_t MerkelMain::simulationMicros() const
+{
+    return MarketDataFeed::timestampToMicros(currentTime) + clockOffset;
+}
+
+void MerkelMain::advanceClock(const std::string &nextTime)
+{
+    uint64_t now = MarketDataFeed::timestampToMicros(currentTime);
+    uint64_t next = MarketDataFeed::timestampToMicros(nextTime);
+    if (next <= now)
+    {
+        // back to the start of the file: carry on a second later
+        clockOffset += now - next + 1000000;
+    }
+
+    std::vector<TimerEvent> expired;
+    timers.advance(next + clockOffset, expired);
+    for (const TimerEvent &event : expired)
+    {
+        if (event.kind == orderExpiry)
+        {
+            auto working = workingOrders.find(event.data);
+            if (working != workingOrders.end())
+            {
+                // it rests at currentTime, so releasing that frees its funds
+                std::cout << "Order " << event.data << " expired with " << working->second.order.amount
+                          << " unfilled" << std::endl;
+                workingOrders.erase(working);
+            }
+        }
+        if (event.kind == statsSnapshot)
+        {
+            timers.schedule(event.dueMicros + snapshotSeconds * 1000000ull, statsSnapshot, 0);
+            snapshots.push_back(nextTime + ": wallet value " + std::to_string(wallet.getMarketValue()) + " " +
+                                wallet.getQuoteCurrency() + ", " + std::to_string(workingOrders.size()) +
+                                " working orders, " + std::to_string(timers.getPendingCount()) + " timers pending");
+        }
+    }
+}
+
+void MerkelMain::carryOverOrders(const std::string &nextTime)
+{
+    for (auto it = workingOrders.begin(); it != workingOrders.end();)
+    {
+        WorkingOrder &working = it->second;
+        if (working.order.amount <= 0)
+        {
+            timers.cancel(working.expiry);
+            it = workingOrders.erase(it);
+            continue;
+        }
+        // take what is left out of the timeframe it rested in, so the id
+        // is only ever live once
+        orderBook.cancelOrder(working.order.orderId, working.order.timestamp);
+        working.order.timestamp = nextTime;
+        OrderBookEntry carried = working.order;
+        orderBook.insertOrder(carried);
+        wallet.moveReservation(carried.orderId, nextTime);
+        ++it;
+    }
+}
+
+void MerkelMain::markToMarket()
+{
+    for (std::string const &p : orderBook.getKnownProducts())
+    {
+        double bestBid = OrderBook::getHighPrice(orderBook.getOrderView(OrderBookType::bid, p, currentTime));
+        double bestAsk = OrderBook::getLowPrice(orderBook.getOrderView(OrderBookType::ask, p, currentTime));
+        wallet.updateMark(p, bestBid, bestAsk);
+    }
+}
+
+void MerkelMain::printStats()
+{
+    // only the arena's own trips to the heap; the sales built from the
+    // fills, their strings and everything else allocate as they please
+    std::cout << "Matching arena: " << arena.getHeapAllocations() << " heap allocations, "
+              << arena.getPeakBytesUsed() << " bytes peak per timeframe, "
+              << arena.getCapacity() << " bytes capacity "
+              << "(allocations outside the arena, such as sales and their strings, are not counted)" << std::endl;
+#if MERKEL_PROFILE
+    std::cout << Profiler::instance().toString();
+    std::ostringstream arenaJson;
+    arenaJson << "\"matchArena\":{\"heapAllocations\":" << arena.getHeapAllocations()
+              << ",\"peakBytesUsed\":" << arena.getPeakBytesUsed()
+              << ",\"capacity\":" << arena.getCapacity()
+              << ",\"covers\":\"matching scratch only, not sales or their strings\"}";
+    std::ofstream json{"profile.json"};
+    json << Profiler::instance().toJson(arenaJson.str()) << std::endl;
+    std::cout << "Wrote profile.json" << std::endl;
+#else
+    std::cout << "Profiling was compiled out (MERKEL_PROFILE=0)" << std::endl;
+#endif
+    for (const std::string &snapshot : snapshots)
+    {
+        std::cout << snapshot << std::endl;
+    }
 }
 
 int MerkelMain::getUserOption()
 {
     int userOption = 0;
     std::string line;
-    std::cout << "Type in 1-6" << std::endl;
+    std::cout << "Type in 1-7" << std::endl;
     std::getline(std::cin, line);
     try
     {
@@ -193,7 +391,7 @@ void MerkelMain::processUserOption(int userOption)
 {
     if (userOption == 0) // bad input
     {
-        std::cout << "Invalid choice. Choose 1-6" << std::endl;
+        std::cout << "Invalid choice. Choose 1-7" << std::endl;
     }
     if (userOption == 1)
     {
@@ -219,4 +417,8 @@ void MerkelMain::processUserOption(int userOption)
     {
         gotoNextTimeframe();
     }
+    if (userOption == 7)
+    {
+        printStats();
+    }
 }
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <map>
 #include <vector>
 #include "OrderBookEntry.h"
 #include "OrderBook.h"
 #include "Wallet.h"
+#include "TimingWheel.h"
 
 class MerkelMain
 {
@@ -17,13 +19,49 @@ class MerkelMain
         void printMarketStats();
         void enterAsk();
         void enterBid();
+        /** reserve funds for an order and rest it in the book, or, for
+         * market, IOC and FOK orders, execute it straight away */
+        void placeOrder(OrderBookEntry& obe, double goodForSeconds = 0);
         void printWallet();
         void gotoNextTimeframe();
+        /** mark the wallet at the top of book of the current timeframe */
+        void markToMarket();
+        /** currentTime in microseconds, kept going forward when the
+         * file wraps round to the start */
+        uint64_t simulationMicros() const;
+        /** move the simulation clock to nextTime, firing any timers due */
+        void advanceClock(const std::string& nextTime);
+        /** rest what is left of each good-till-time order at nextTime */
+        void carryOverOrders(const std::string& nextTime);
+        /** print the profiling counters and the matching arena's heap use
+         * and dump them to profile.json */
+        void printStats();
         int getUserOption();
         void processUserOption(int userOption);
 
         std::string currentTime;
 
         OrderBook orderBook{"20200317.csv"};
+        /** scratch space for matching, reset after every timeframe */
+        MatchArena arena;
         Wallet wallet;
+
+        /** what a timer on the simulation clock is for */
+        enum TimerKind
+        {
+            orderExpiry,
+            statsSnapshot
+        };
+        /** a good-till-time order that is still working */
+        struct WorkingOrder
+        {
+            OrderBookEntry order;
+            TimerId expiry;
+        };
+        TimingWheel timers;
+        std::map<unsigned long, WorkingOrder> workingOrders;
+        uint64_t clockOffset = 0;
+        /** one line per stats snapshot, every snapshotSeconds of simulated time */
+        std::vector<std::string> snapshots;
+        static const int snapshotSeconds = 30;
 };
@@ -1,5 +1,6 @@
 #include "OrderBook.h"
 #include "CSVReader.h"
+#include "Profiler.h"
 #include <map>
 #include <algorithm>
 #include <iostream>
@@ -7,38 +8,41 @@
 /** construct, reading a csv data file */
 OrderBook::OrderBook(std::string filename)
 {
-    orders = CSVReader::readCSV(filename);
-}
-/** return vector of all know products in the dataset*/
-std::vector<std::string> OrderBook::getKnownProducts()
-{
-    std::vector<std::string> products;
-
-    std::map<std::string, bool> prodMap;
-
-    for (OrderBookEntry &e : orders)
+    std::vector<OrderBookEntry> entries = CSVReader::readCSV(filename);
+    PROFILE_SCOPE(index);
+    for (OrderBookEntry &e : entries)
     {
-        prodMap[e.product] = true;
+        e.orderId = nextOrderId++;
+        addKnownProduct(e.product);
     }
+    datasetOrderCount = entries.size();
+    orders = OrderFrames{std::move(entries)};
+}
+/** return all know products in the dataset, sorted by name */
+const std::vector<std::string> &OrderBook::getKnownProducts() const
+{
+    return knownProducts;
+}
 
-    for (auto const &e : prodMap)
+void OrderBook::addKnownProduct(const std::string &product)
+{
+    auto it = std::lower_bound(knownProducts.begin(), knownProducts.end(), product);
+    if (it == knownProducts.end() || *it != product)
     {
-        products.push_back(e.first);
+        knownProducts.insert(it, product);
     }
-
-    return products;
 }
+
 /** return vector of Orders according to the sent filters*/
 std::vector<OrderBookEntry> OrderBook::getOrders(OrderBookType type,
                                                  std::string product,
                                                  std::string timestamp)
 {
     std::vector<OrderBookEntry> orders_sub;
-    for (OrderBookEntry &e : orders)
+    for (const OrderBookEntry &e : getOrdersAt(timestamp))
     {
         if (e.orderType == type &&
-            e.product == product &&
-            e.timestamp == timestamp)
+            e.product == product)
         {
             orders_sub.push_back(e);
         }
@@ -46,55 +50,254 @@ std::vector<OrderBookEntry> OrderBook::getOrders(OrderBookType type,
     return orders_sub;
 }
 
-double OrderBook::getHighPrice(std::vector<OrderBookEntry> &orders)
+OrderSpan OrderBook::getOrdersAt(const std::string &timestamp) const
+{
+    size_t i = orders.find(timestamp);
+    if (i == orders.frameCount())
+        return OrderSpan{nullptr, nullptr};
+    return orders.frame(i);
+}
+
+double OrderBook::executeImmediate(OrderBookEntry &order,
+                                  MatchArena &arena,
+                                  std::vector<OrderBookEntry> &sales)
+{
+    PROFILE_SCOPE(execute);
+    if (order.execution == OrderExecution::limit || order.amount <= 0 ||
+        (order.orderType != OrderBookType::ask && order.orderType != OrderBookType::bid))
+    {
+        return 0;
+    }
+    bool isBid = order.orderType == OrderBookType::bid;
+    OrderBookType opposite = isBid ? OrderBookType::ask : OrderBookType::bid;
+    bool anyPrice = order.execution == OrderExecution::market;
+
+    // the opposite side's resting orders we may trade with, by pointer.
+    // the timeframe is written to, so it stops being shared with snapshots
+    size_t frameIndex = orders.find(order.timestamp);
+    std::pmr::vector<OrderBookEntry *> resting{&arena};
+    double available = 0;
+    OrderBookEntry *first = nullptr;
+    OrderBookEntry *last = nullptr;
+    if (frameIndex < orders.frameCount())
+    {
+        std::vector<OrderBookEntry> &frame = orders.mutableFrame(frameIndex);
+        first = frame.data();
+        last = first + frame.size();
+    }
+    for (OrderBookEntry *e = first; e != last; ++e)
+    {
+        if (e->orderType != opposite || e->product != order.product || e->amount <= 0)
+            continue;
+        if (!anyPrice && (isBid ? e->price > order.price : e->price < order.price))
+            continue;
+        resting.push_back(e);
+        available += e->amount;
+    }
+    if (order.execution == OrderExecution::fillOrKill && available < order.amount)
+    {
+        return 0;
+    }
+    // announce the order so its executions, and the cancel for what does
+    // not fill, have something to apply to on the feed
+    if (order.orderId == 0)
+    {
+        order.orderId = newOrderId();
+    }
+    if (feed != nullptr)
+        feed->publishAdd(order);
+
+    // best price first, then first come first served. the order usually
+    // fills against a few of them, so heap them in O(n) and pop only as
+    // many as it takes rather than sorting the lot
+    auto worse = [isBid](const OrderBookEntry *a, const OrderBookEntry *b)
+    {
+        if (a->price != b->price)
+            return isBid ? a->price > b->price : a->price < b->price;
+        return a > b;
+    };
+    std::make_heap(resting.begin(), resting.end(), worse);
+
+    double filled = 0;
+    bool emptied = false;
+    [[maybe_unused]] size_t salesBefore = sales.size();
+    for (auto end = resting.end(); end != resting.begin(); --end)
+    {
+        std::pop_heap(resting.begin(), end, worse);
+        OrderBookEntry *e = *(end - 1);
+        double amount = std::min(order.amount - filled, e->amount);
+        Fill fill = isBid ? Fill{e, &order, e->price, amount} : Fill{&order, e, e->price, amount};
+        sales.push_back(fill.toSale());
+        if (feed != nullptr)
+        {
+            feed->publishExecute(*e, amount);
+            feed->publishTrade(sales.back());
+        }
+        if (topOfBook != nullptr)
+            topOfBook->publishTrade(order.product, e->price, amount);
+        e->amount -= amount;
+        emptied = emptied || e->amount <= 0;
+        filled += amount;
+        if (filled >= order.amount)
+            break;
+    }
+    PROFILE_ITEMS(execute, sales.size() - salesBefore);
+    if (feed != nullptr)
+    {
+        if (filled > 0)
+            feed->publishExecute(order, filled);
+        // what did not fill does not rest
+        if (order.amount - filled > 0)
+            feed->publishCancel(order, order.amount - filled);
+        feed->flush();
+    }
+
+    // filled resting orders would otherwise show up as zero amount fills
+    if (emptied)
+    {
+        std::vector<OrderBookEntry> &frame = orders.mutableFrame(frameIndex);
+        frame.erase(std::remove_if(frame.begin(), frame.end(), [](const OrderBookEntry &e)
+                                   { return e.amount <= 0 && (e.orderType == OrderBookType::ask ||
+                                                              e.orderType == OrderBookType::bid); }),
+                    frame.end());
+        if (frame.empty())
+            orders.eraseFrame(frameIndex);
+    }
+    order.amount -= filled;
+    publishTop(order.product, order.timestamp);
+    return filled;
+}
+
+std::vector<OrderSpan> OrderBook::getTimeframes() const
 {
-    double max = orders[0].price;
-    for (OrderBookEntry &e : orders)
+    std::vector<OrderSpan> frames;
+    for (size_t i = 0; i < orders.frameCount(); ++i)
     {
-        if (e.price > max)
-            max = e.price;
+        frames.push_back(orders.frame(i));
     }
-    return max;
+    return frames;
 }
 
-double OrderBook::getLowPrice(std::vector<OrderBookEntry> &orders)
+OrderView OrderBook::getOrderView(OrderBookType type,
+                                  const std::string &product,
+                                  const std::string &timestamp) const
 {
-    double min = orders[0].price;
-    for (OrderBookEntry &e : orders)
+    return OrderView{getOrdersAt(timestamp), type, product};
+}
+
+bool OrderBook::compactBefore(const std::string &timestamp)
+{
+    size_t end = orders.lowerBound(timestamp);
+    std::vector<OrderSegment> segments;
+    try
+    {
+        for (size_t i = 0; i < end; ++i)
+        {
+            OrderSpan frame = orders.frame(i);
+            segments.push_back(OrderSegment{frame.begin(), frame.end()});
+        }
+    }
+    catch (const std::exception &e)
     {
-        if (e.price < min)
-            min = e.price;
+        return false;
     }
-    return min;
+
+    // snapshots keep the history they were taken with
+    if (history.use_count() > 1)
+        history = std::make_shared<std::vector<OrderSegment>>(*history);
+    history->insert(history->end(),
+                    std::make_move_iterator(segments.begin()),
+                    std::make_move_iterator(segments.end()));
+    orders.eraseBefore(end);
+    return true;
+}
+
+const std::vector<OrderSegment> &OrderBook::getHistory() const
+{
+    return *history;
+}
+
+std::vector<OrderBookEntry> OrderBook::getAllOrders() const
+{
+    return orders.flatten();
+}
+
+OrderBook OrderBook::snapshot() const
+{
+    OrderBook copy = *this;
+    copy.feed = nullptr;
+    copy.topOfBook = nullptr;
+    return copy;
+}
+
+size_t OrderBook::getSharedTimeframeCount() const
+{
+    return orders.getSharedFrameCount();
 }
 
 std::string OrderBook::getEarliestTime()
 {
-    return orders[0].timestamp;
+    return orders.getTimestamp(0);
 }
 
 std::string OrderBook::getNextTime(std::string timestamp)
 {
     std::string next_timestamp = "";
-    for (OrderBookEntry &e : orders)
+    // timeframes are in time order, so binary search rather than scan
+    size_t next = orders.upperBound(timestamp);
+    if (next < orders.frameCount())
     {
-        if (e.timestamp > timestamp)
-        {
-            next_timestamp = e.timestamp;
-            break;
-        }
+        next_timestamp = orders.getTimestamp(next);
     }
     if (next_timestamp == "")
     {
-        next_timestamp = orders[0].timestamp;
+        next_timestamp = orders.getTimestamp(0);
     }
     return next_timestamp;
 }
 
 void OrderBook::insertOrder(OrderBookEntry &order)
 {
-    orders.push_back(order);
-    std::sort(orders.begin(), orders.end(), OrderBookEntry::compareByTimestamp);
+    if (order.orderId == 0)
+    {
+        order.orderId = newOrderId();
+    }
+    if (feed != nullptr)
+    {
+        feed->publishAdd(order);
+        feed->flush();
+    }
+    addKnownProduct(order.product);
+    // orders are already in time order, so slot it in rather than re-sort
+    orders.insert(order);
+    publishTop(order.product, order.timestamp);
+}
+
+bool OrderBook::cancelOrder(unsigned long orderId, const std::string &timestamp)
+{
+    size_t frameIndex = orders.find(timestamp);
+    if (frameIndex >= orders.frameCount())
+    {
+        return false;
+    }
+    std::vector<OrderBookEntry> &frame = orders.mutableFrame(frameIndex);
+    auto it = std::find_if(frame.begin(), frame.end(), [orderId](const OrderBookEntry &e)
+                           { return e.orderId == orderId; });
+    if (it == frame.end())
+    {
+        return false;
+    }
+    if (feed != nullptr)
+    {
+        feed->publishCancel(*it, it->amount);
+        feed->flush();
+    }
+    std::string product = it->product;
+    frame.erase(it);
+    if (frame.empty())
+        orders.eraseFrame(frameIndex);
+    publishTop(product, timestamp);
+    return true;
 }
 
 std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std::string timestamp)
@@ -110,11 +313,225 @@ std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std:
 
     std::sort(asks.begin(), asks.end(), OrderBookEntry::compareByPriceAsc);
     std::sort(bids.begin(), bids.end(), OrderBookEntry::compareByPriceDesc);
-    std::cout << "max ask " << asks[asks.size() - 1].price << std::endl;
-    std::cout << "min ask " << asks[0].price << std::endl;
-    std::cout << "max bid " << bids[0].price << std::endl;
-    std::cout << "min bid " << bids[bids.size() - 1].price << std::endl;
+    // the last timeframe in the file does not have every product
+    if (printPriceRanges && asks.size() > 0 && bids.size() > 0)
+    {
+        std::cout << "max ask " << asks[asks.size() - 1].price << std::endl;
+        std::cout << "min ask " << asks[0].price << std::endl;
+        std::cout << "max bid " << bids[0].price << std::endl;
+        std::cout << "min bid " << bids[bids.size() - 1].price << std::endl;
+    }
+    if (topOfBook != nullptr)
+    {
+        topOfBook->publishQuote(product, bids.empty() ? 0 : bids[0].price, asks.empty() ? 0 : asks[0].price);
+    }
 
+    if (feed == nullptr)
+    {
+        matchSortedOrders(asks, bids, product, timestamp, sales);
+        if (topOfBook != nullptr && !sales.empty())
+            topOfBook->publishTrade(product, sales.back().price, sales.back().amount);
+        return sales;
+    }
+
+    // remember the starting amounts so we can tell what each order filled
+    std::vector<double> askAmounts, bidAmounts;
+    for (OrderBookEntry &e : asks)
+        askAmounts.push_back(e.amount);
+    for (OrderBookEntry &e : bids)
+        bidAmounts.push_back(e.amount);
+
+    matchSortedOrders(asks, bids, product, timestamp, sales);
+    publishMatch(asks, bids, askAmounts, bidAmounts, sales);
+    if (topOfBook != nullptr && !sales.empty())
+        topOfBook->publishTrade(product, sales.back().price, sales.back().amount);
+    return sales;
+}
+
+unsigned long OrderBook::newOrderId()
+{
+    return nextOrderId++;
+}
+
+void OrderBook::matchProduct(const std::string &product,
+                             const std::string &timestamp,
+                             MatchArena &arena,
+                             std::pmr::vector<Fill> &fills) const
+{
+    matchProduct(product, getOrdersAt(timestamp), arena, fills);
+}
+
+void OrderBook::matchProduct(const std::string &product,
+                             OrderSpan frame,
+                             MatchArena &arena,
+                             std::pmr::vector<Fill> &fills) const
+{
+    /** an order and how much of it is left to fill */
+    struct Resting
+    {
+        const OrderBookEntry *order;
+        double amount;
+    };
+
+    std::pmr::vector<Resting> asks{&arena};
+    std::pmr::vector<Resting> bids{&arena};
+    for (const OrderBookEntry &e : frame)
+    {
+        if (e.product != product)
+            continue;
+        if (e.orderType == OrderBookType::ask)
+            asks.push_back(Resting{&e, e.amount});
+        if (e.orderType == OrderBookType::bid)
+            bids.push_back(Resting{&e, e.amount});
+    }
+
+    std::sort(asks.begin(), asks.end(), [](const Resting &a, const Resting &b)
+              { return a.order->price < b.order->price; });
+    std::sort(bids.begin(), bids.end(), [](const Resting &a, const Resting &b)
+              { return a.order->price > b.order->price; });
+
+    // the same rules as matchSortedOrders, so the fills come out identical
+    for (Resting &ask : asks)
+    {
+        for (Resting &bid : bids)
+        {
+            // bids are sorted high to low, so none of the rest can match either
+            if (bid.order->price < ask.order->price)
+                break;
+
+            if (bid.amount == ask.amount)
+            {
+                fills.push_back(Fill{ask.order, bid.order, ask.order->price, ask.amount});
+                bid.amount = 0;
+                ask.amount = 0;
+                break;
+            }
+            if (bid.amount > ask.amount)
+            {
+                fills.push_back(Fill{ask.order, bid.order, ask.order->price, ask.amount});
+                bid.amount = bid.amount - ask.amount;
+                ask.amount = 0;
+                break;
+            }
+            if (bid.amount < ask.amount && bid.amount > 0)
+            {
+                fills.push_back(Fill{ask.order, bid.order, ask.order->price, bid.amount});
+                ask.amount = ask.amount - bid.amount;
+                bid.amount = 0;
+                continue;
+            }
+        }
+    }
+}
+
+OrderBookEntry Fill::toSale() const
+{
+    OrderBookEntry sale{price, amount, ask->timestamp, ask->product, OrderBookType::asksale};
+    if (bid->username == "simuser")
+    {
+        sale.username = "simuser";
+        sale.orderType = OrderBookType::bidsale;
+        sale.orderId = bid->orderId;
+    }
+    if (ask->username == "simuser")
+    {
+        sale.username = "simuser";
+        sale.orderType = OrderBookType::asksale;
+        sale.orderId = ask->orderId;
+    }
+    return sale;
+}
+
+void OrderBook::setFeed(MarketDataFeed *_feed)
+{
+    feed = _feed;
+}
+
+void OrderBook::setTopOfBook(TopOfBookPublisher *_topOfBook)
+{
+    topOfBook = _topOfBook;
+}
+
+void OrderBook::setPrintPriceRanges(bool print)
+{
+    printPriceRanges = print;
+}
+
+bool OrderBook::getPrintPriceRanges() const
+{
+    return printPriceRanges;
+}
+
+void OrderBook::publishTop(const std::string &product, const std::string &timestamp)
+{
+    if (topOfBook == nullptr)
+        return;
+    topOfBook->publishQuote(product,
+                            getHighPrice(getOrderView(OrderBookType::bid, product, timestamp)),
+                            getLowPrice(getOrderView(OrderBookType::ask, product, timestamp)));
+}
+
+void OrderBook::publishMatch(std::vector<OrderBookEntry> &asks,
+                             std::vector<OrderBookEntry> &bids,
+                             const std::vector<double> &askAmounts,
+                             const std::vector<double> &bidAmounts,
+                             const std::vector<OrderBookEntry> &sales)
+{
+    // dataset orders only arrive once their timeframe comes round
+    for (size_t i = 0; i < asks.size(); ++i)
+    {
+        if (asks[i].orderId <= datasetOrderCount)
+        {
+            OrderBookEntry add = asks[i];
+            add.amount = askAmounts[i];
+            feed->publishAdd(add);
+        }
+    }
+    for (size_t i = 0; i < bids.size(); ++i)
+    {
+        if (bids[i].orderId <= datasetOrderCount)
+        {
+            OrderBookEntry add = bids[i];
+            add.amount = bidAmounts[i];
+            feed->publishAdd(add);
+        }
+    }
+
+    for (size_t i = 0; i < asks.size(); ++i)
+    {
+        if (asks[i].amount < askAmounts[i])
+            feed->publishExecute(asks[i], askAmounts[i] - asks[i].amount);
+    }
+    for (size_t i = 0; i < bids.size(); ++i)
+    {
+        if (bids[i].amount < bidAmounts[i])
+            feed->publishExecute(bids[i], bidAmounts[i] - bids[i].amount);
+    }
+    for (const OrderBookEntry &sale : sales)
+    {
+        feed->publishTrade(sale);
+    }
+
+    // orders only match within their own timeframe, so whatever is left is gone
+    for (OrderBookEntry &e : asks)
+    {
+        if (e.amount > 0)
+            feed->publishCancel(e, e.amount);
+    }
+    for (OrderBookEntry &e : bids)
+    {
+        if (e.amount > 0)
+            feed->publishCancel(e, e.amount);
+    }
+    feed->flush();
+}
+
+void OrderBook::matchSortedOrders(std::vector<OrderBookEntry> &asks,
+                                  std::vector<OrderBookEntry> &bids,
+                                  std::string product,
+                                  std::string timestamp,
+                                  std::vector<OrderBookEntry> &sales)
+{
     for (OrderBookEntry &ask : asks)
     {
         for (OrderBookEntry &bid : bids)
@@ -127,11 +544,13 @@ std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std:
                 {
                     sale.username = "simuser";
                     sale.orderType = OrderBookType::bidsale;
+                    sale.orderId = bid.orderId;
                 }
                 if (ask.username == "simuser")
                 {
                     sale.username = "simuser";
                     sale.orderType = OrderBookType::asksale;
+                    sale.orderId = ask.orderId;
                 }
 
                 if (bid.amount == ask.amount)
@@ -139,6 +558,7 @@ std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std:
                     sale.amount = ask.amount;
                     sales.push_back(sale);
                     bid.amount = 0;
+                    ask.amount = 0;
                     break;
                 }
                 if (bid.amount > ask.amount)
@@ -146,6 +566,7 @@ std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std:
                     sale.amount = ask.amount;
                     sales.push_back(sale);
                     bid.amount = bid.amount - ask.amount;
+                    ask.amount = 0;
                     break;
                 }
 
@@ -160,5 +581,4 @@ std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std:
             }
         }
     }
-    return sales;
 }
@@ -1,20 +1,50 @@
 #pragma once
 #include "OrderBookEntry.h"
 #include "CSVReader.h"
+#include "MarketDataFeed.h"
+#include "MatchArena.h"
+#include "OrderView.h"
+#include "OrderFrames.h"
+#include "OrderSegment.h"
+#include "SharedTopOfBook.h"
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
+/** one trade found by OrderBook::matchProduct. ask and bid point at the
+ * orders in the book, so nothing is copied */
+struct Fill
+{
+    const OrderBookEntry* ask;
+    const OrderBookEntry* bid;
+    double price;
+    double amount;
+
+    /** the sale as matchAsksToBids would have returned it */
+    OrderBookEntry toSale() const;
+};
+
 class OrderBook
 {
     public:
     /** construct, reading a csv data file */
         OrderBook(std::string filename);
-    /** return vector of all know products in the dataset*/
-        std::vector<std::string> getKnownProducts();
+    /** return all know products in the dataset, sorted by name.
+     * the list is kept up to date as orders come in, so this does not copy */
+        const std::vector<std::string>& getKnownProducts() const;
     /** return vector of Orders according to the sent filters*/
         std::vector<OrderBookEntry> getOrders(OrderBookType type, 
                                               std::string product, 
                                               std::string timestamp);
+    /** the orders at this timestamp, without copying them */
+        OrderSpan getOrdersAt(const std::string& timestamp) const;
+    /** every live timeframe, in time order */
+        std::vector<OrderSpan> getTimeframes() const;
+    /** the orders matching the filters, without copying them */
+        OrderView getOrderView(OrderBookType type,
+                               const std::string& product,
+                               const std::string& timestamp) const;
 
         /** returns the earliest time in the orderbook*/
         std::string getEarliestTime();
@@ -24,14 +54,141 @@ class OrderBook
          * */
         std::string getNextTime(std::string timestamp);
 
+        /** add an order, giving it the next order id if it does not have one */
         void insertOrder(OrderBookEntry& order);
+        /** hand out an order id ahead of insertOrder, e.g. so a wallet
+         * can reserve funds against the order first */
+        unsigned long newOrderId();
+        /** take an order out of its timeframe, publishing a cancel for
+         * whatever the book still had of it. returns false if it is not there */
+        bool cancelOrder(unsigned long orderId, const std::string& timestamp);
+
+        /** publish adds, executes, cancels and trades to this feed from now
+         * on, or stop publishing if feed is nullptr. dataset orders are
+         * added when their timeframe is matched; inserted orders straight away */
+        void setFeed(MarketDataFeed* feed);
+        /** publish each product's best bid/ask as orders arrive, and its
+         * trades, to this shared memory region, or stop if nullptr */
+        void setTopOfBook(TopOfBookPublisher* topOfBook);
+        /** whether matchAsksToBids prints each product's price ranges, as
+         * it does by default for the menu */
+        void setPrintPriceRanges(bool print);
+        bool getPrintPriceRanges() const;
 
         std::vector<OrderBookEntry> matchAsksToBids(std::string product, std::string timestamp);
+        /** match one product at one timestamp the same way as matchAsksToBids,
+         * but with all scratch space taken from arena, appending to fills
+         * (which should use the same arena). fills are only valid until the
+         * book changes or the arena is reset */
+        void matchProduct(const std::string& product,
+                          const std::string& timestamp,
+                          MatchArena& arena,
+                          std::pmr::vector<Fill>& fills) const;
+        /** the same, for a timeframe already looked up with getOrdersAt.
+         * only reads the book, so different threads can match different
+         * timeframes at once as long as nothing is inserted meanwhile */
+        void matchProduct(const std::string& product,
+                          OrderSpan frame,
+                          MatchArena& arena,
+                          std::pmr::vector<Fill>& fills) const;
+        /** execute a market, immediateOrCancel or fillOrKill order against
+         * the opposite side resting in its timeframe, best price first.
+         * resting orders are filled in place (and dropped once empty), the
+         * sales are appended to sales and order.amount is left holding what
+         * was not filled, which does not rest. on the feed the order is
+         * added, executed against each resting order it reduces and the
+         * rest cancelled. returns the amount filled */
+        double executeImmediate(OrderBookEntry& order,
+                                MatchArena& arena,
+                                std::vector<OrderBookEntry>& sales);
+        /** match asks (sorted low to high) against bids (sorted high to low),
+         * appending the resulting sales. amounts in asks and bids are used up */
+        static void matchSortedOrders(std::vector<OrderBookEntry>& asks,
+                                      std::vector<OrderBookEntry>& bids,
+                                      std::string product,
+                                      std::string timestamp,
+                                      std::vector<OrderBookEntry>& sales);
+
+        /** compress every timeframe before timestamp into an OrderSegment,
+         * one per timeframe, and drop them from the live orders. queries on
+         * the live orders (and any views or Fills into them) no longer see
+         * those timeframes; scan getHistory() for them instead.
+         * returns false, leaving the book alone, if they cannot be compressed */
+        bool compactBefore(const std::string& timestamp);
+        /** the compressed timeframes, oldest first */
+        const std::vector<OrderSegment>& getHistory() const;
+
+        /** a copy of every live order, in timestamp order */
+        std::vector<OrderBookEntry> getAllOrders() const;
+
+        /** a copy of the book that shares all its orders and history with
+         * this one, so it takes O(1) however big the book is. either copy
+         * can then change without the other seeing it; a change copies just
+         * the timeframe it touches. the snapshot does not publish to the
+         * feed or top of book. (a plain copy of the book shares the same
+         * way, but keeps publishing) */
+        OrderBook snapshot() const;
+        /** how many timeframes are still shared with a snapshot or copy */
+        size_t getSharedTimeframeCount() const;
 
-        static double getHighPrice(std::vector<OrderBookEntry>& orders);
-        static double getLowPrice(std::vector<OrderBookEntry>& orders);
+        /** highest / lowest price in any range of orders, e.g. a vector,
+         * an OrderSpan or an OrderView. 0 if the range is empty */
+        template <typename Range>
+        static double getHighPrice(const Range& orders);
+        template <typename Range>
+        static double getLowPrice(const Range& orders);
 
     private:
-        std::vector<OrderBookEntry> orders;
+        /** publish one matched product/timeframe to the feed */
+        void publishMatch(std::vector<OrderBookEntry>& asks,
+                          std::vector<OrderBookEntry>& bids,
+                          const std::vector<double>& askAmounts,
+                          const std::vector<double>& bidAmounts,
+                          const std::vector<OrderBookEntry>& sales);
+
+        /** publish product's best bid and ask at timestamp, if publishing */
+        void publishTop(const std::string& product, const std::string& timestamp);
+
+        /** add product to knownProducts if it is new, keeping it sorted */
+        void addKnownProduct(const std::string& product);
+
+        OrderFrames orders;
+        std::vector<std::string> knownProducts;
+        /** shared with snapshots until one of them compacts */
+        std::shared_ptr<std::vector<OrderSegment>> history = std::make_shared<std::vector<OrderSegment>>();
+        /** ids up to this one came from the csv file */
+        unsigned long datasetOrderCount = 0;
+        unsigned long nextOrderId = 1;
+        MarketDataFeed* feed = nullptr;
+        TopOfBookPublisher* topOfBook = nullptr;
+        bool printPriceRanges = true;
 
 };
+
+template <typename Range>
+double OrderBook::getHighPrice(const Range& orders)
+{
+    bool first = true;
+    double max = 0;
+    for (const OrderBookEntry& e : orders)
+    {
+        if (first || e.price > max)
+            max = e.price;
+        first = false;
+    }
+    return max;
+}
+
+template <typename Range>
+double OrderBook::getLowPrice(const Range& orders)
+{
+    bool first = true;
+    double min = 0;
+    for (const OrderBookEntry& e : orders)
+    {
+        if (first || e.price < min)
+            min = e.price;
+        first = false;
+    }
+    return min;
+}
@@ -1,4 +1,5 @@
 #include "OrderBookEntry.h"
+#include <exception>
 
 OrderBookEntry::OrderBookEntry( double _price, 
                         double _amount, 
@@ -28,3 +29,24 @@ OrderBookType OrderBookEntry::stringToOrderBookType(std::string s)
   }
   return OrderBookType::unknown;
 }
+
+OrderExecution OrderBookEntry::stringToOrderExecution(std::string s)
+{
+  if (s == "limit")
+  {
+    return OrderExecution::limit;
+  }
+  if (s == "market")
+  {
+    return OrderExecution::market;
+  }
+  if (s == "ioc")
+  {
+    return OrderExecution::immediateOrCancel;
+  }
+  if (s == "fok")
+  {
+    return OrderExecution::fillOrKill;
+  }
+  throw std::exception{};
+}
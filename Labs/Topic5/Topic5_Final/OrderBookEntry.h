@@ -11,6 +11,18 @@ enum class OrderBookType
     bidsale
 };
 
+/** how an ask or bid executes. limit orders rest until their timeframe is
+ * matched. the others execute against what is resting as soon as they are
+ * entered and never rest: market takes any price, immediateOrCancel only
+ * up to its price, and fillOrKill the same but only if it fills in full */
+enum class OrderExecution
+{
+    limit,
+    market,
+    immediateOrCancel,
+    fillOrKill
+};
+
 class OrderBookEntry
 {
 public:
@@ -22,16 +34,18 @@ public:
                    std::string _username = "dataset");
 
     static OrderBookType stringToOrderBookType(std::string s);
+    /** "limit", "market", "ioc" or "fok". throws std::exception otherwise */
+    static OrderExecution stringToOrderExecution(std::string s);
 
-    static bool compareByTimestamp(OrderBookEntry &e1, OrderBookEntry &e2)
+    static bool compareByTimestamp(const OrderBookEntry &e1, const OrderBookEntry &e2)
     {
         return e1.timestamp < e2.timestamp;
     }
-    static bool compareByPriceAsc(OrderBookEntry &e1, OrderBookEntry &e2)
+    static bool compareByPriceAsc(const OrderBookEntry &e1, const OrderBookEntry &e2)
     {
         return e1.price < e2.price;
     }
-    static bool compareByPriceDesc(OrderBookEntry &e1, OrderBookEntry &e2)
+    static bool compareByPriceDesc(const OrderBookEntry &e1, const OrderBookEntry &e2)
     {
         return e1.price > e2.price;
     }
@@ -43,4 +57,8 @@ public:
     OrderBookType orderType;
 
     std::string username;
+    /** set by the OrderBook, so feed messages and wallets can refer to the order.
+     * for a simuser sale, the id of the simuser order that traded */
+    unsigned long orderId = 0;
+    OrderExecution execution = OrderExecution::limit;
 };
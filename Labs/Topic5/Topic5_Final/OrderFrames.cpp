@@ -0,0 +1,151 @@
+#include "OrderFrames.h"
+#include <algorithm>
+#include <iterator>
+
+OrderFrames::OrderFrames()
+: frames(std::make_shared<std::vector<Frame>>())
+{
+
+}
+
+OrderFrames::OrderFrames(std::vector<OrderBookEntry> orders)
+: frames(std::make_shared<std::vector<Frame>>())
+{
+    size_t start = 0;
+    while (start < orders.size())
+    {
+        size_t end = start;
+        while (end < orders.size() && orders[end].timestamp == orders[start].timestamp)
+        {
+            ++end;
+        }
+        frames->push_back(std::make_shared<std::vector<OrderBookEntry>>(
+            std::make_move_iterator(orders.begin() + start),
+            std::make_move_iterator(orders.begin() + end)));
+        start = end;
+    }
+}
+
+size_t OrderFrames::frameCount() const
+{
+    return frames->size();
+}
+
+size_t OrderFrames::orderCount() const
+{
+    size_t count = 0;
+    for (const Frame& frame : *frames)
+    {
+        count += frame->size();
+    }
+    return count;
+}
+
+bool OrderFrames::empty() const
+{
+    return frames->empty();
+}
+
+size_t OrderFrames::lowerBound(const std::string& timestamp) const
+{
+    auto it = std::lower_bound(frames->begin(), frames->end(), timestamp,
+                               [](const Frame& f, const std::string& t)
+                               { return f->front().timestamp < t; });
+    return it - frames->begin();
+}
+
+size_t OrderFrames::upperBound(const std::string& timestamp) const
+{
+    auto it = std::upper_bound(frames->begin(), frames->end(), timestamp,
+                               [](const std::string& t, const Frame& f)
+                               { return t < f->front().timestamp; });
+    return it - frames->begin();
+}
+
+size_t OrderFrames::find(const std::string& timestamp) const
+{
+    size_t i = lowerBound(timestamp);
+    if (i < frames->size() && (*frames)[i]->front().timestamp == timestamp)
+        return i;
+    return frames->size();
+}
+
+OrderSpan OrderFrames::frame(size_t i) const
+{
+    const std::vector<OrderBookEntry>& orders = *(*frames)[i];
+    return OrderSpan{orders.data(), orders.data() + orders.size()};
+}
+
+const std::string& OrderFrames::getTimestamp(size_t i) const
+{
+    return (*frames)[i]->front().timestamp;
+}
+
+void OrderFrames::detach()
+{
+    if (frames.use_count() > 1)
+    {
+        frames = std::make_shared<std::vector<Frame>>(*frames);
+    }
+}
+
+std::vector<OrderBookEntry>& OrderFrames::mutableFrame(size_t i)
+{
+    detach();
+    Frame& frame = (*frames)[i];
+    if (frame.use_count() > 1)
+    {
+        frame = std::make_shared<std::vector<OrderBookEntry>>(*frame);
+    }
+    return *frame;
+}
+
+void OrderFrames::insert(const OrderBookEntry& order)
+{
+    size_t i = find(order.timestamp);
+    if (i < frames->size())
+    {
+        mutableFrame(i).push_back(order);
+        return;
+    }
+    detach();
+    frames->insert(frames->begin() + lowerBound(order.timestamp),
+                   std::make_shared<std::vector<OrderBookEntry>>(1, order));
+}
+
+void OrderFrames::eraseFrame(size_t i)
+{
+    detach();
+    frames->erase(frames->begin() + i);
+}
+
+void OrderFrames::eraseBefore(size_t end)
+{
+    detach();
+    frames->erase(frames->begin(), frames->begin() + end);
+}
+
+std::vector<OrderBookEntry> OrderFrames::flatten() const
+{
+    std::vector<OrderBookEntry> orders;
+    orders.reserve(orderCount());
+    for (const Frame& frame : *frames)
+    {
+        orders.insert(orders.end(), frame->begin(), frame->end());
+    }
+    return orders;
+}
+
+size_t OrderFrames::getSharedFrameCount() const
+{
+    // a list shared with another copy shares every frame in it
+    if (frames.use_count() > 1)
+        return frames->size();
+    size_t shared = 0;
+    for (const Frame& frame : *frames)
+    {
+        if (frame.use_count() > 1)
+            ++shared;
+    }
+    return shared;
+}
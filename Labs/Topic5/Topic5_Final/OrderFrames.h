@@ -0,0 +1,68 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "OrderView.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/** The live orders of an OrderBook, one vector per timestamp, shared
+ * between copies until one of them changes.
+ *
+ * Copying an OrderFrames copies a single pointer, so a snapshot of a book
+ * of any size is O(1). The list of timeframes and each timeframe's orders
+ * are reference counted: a copy that wants to write first takes its own
+ * copy of the list (one pointer per timeframe) if anyone else shares it,
+ * and then of just the timeframe it is changing. Everything else stays
+ * shared, however many copies are made or how far they drift apart.
+ *
+ * Timeframes are kept in time order and are never empty. Orders within a
+ * timeframe are contiguous, so OrderSpans over one still work.
+ * Not thread-safe for writing, like the rest of OrderBook; copies can be
+ * changed on different threads since neither writes anything shared.
+ */
+class OrderFrames
+{
+    public:
+        OrderFrames();
+    /** group orders that are already in time order, moving them in */
+        OrderFrames(std::vector<OrderBookEntry> orders);
+
+        size_t frameCount() const;
+    /** the orders in every timeframe */
+        size_t orderCount() const;
+        bool empty() const;
+
+    /** index of the first timeframe at or after timestamp */
+        size_t lowerBound(const std::string& timestamp) const;
+    /** index of the first timeframe after timestamp */
+        size_t upperBound(const std::string& timestamp) const;
+    /** index of the timeframe at timestamp, or frameCount() if there is none */
+        size_t find(const std::string& timestamp) const;
+
+        OrderSpan frame(size_t i) const;
+        const std::string& getTimestamp(size_t i) const;
+
+    /** timeframe i for writing, copied first if anything else shares it */
+        std::vector<OrderBookEntry>& mutableFrame(size_t i);
+    /** add an order, in a new timeframe if it has a new timestamp,
+     * after any others at the same timestamp */
+        void insert(const OrderBookEntry& order);
+    /** drop timeframe i, e.g. once it has no orders left */
+        void eraseFrame(size_t i);
+    /** drop timeframes [0, end) */
+        void eraseBefore(size_t end);
+
+    /** every order, in time order */
+        std::vector<OrderBookEntry> flatten() const;
+    /** how many timeframes are shared with another copy */
+        size_t getSharedFrameCount() const;
+
+    private:
+        typedef std::shared_ptr<std::vector<OrderBookEntry>> Frame;
+
+    /** take our own copy of the timeframe list if it is shared */
+        void detach();
+
+        std::shared_ptr<std::vector<Frame>> frames;
+};
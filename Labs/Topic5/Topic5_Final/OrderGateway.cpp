@@ -0,0 +1,374 @@
+#include "OrderGateway.h"
+#include "ThreadPlacement.h"
+#include "CSVReader.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+OrderGateway::OrderGateway(OrderBook& _orderBook, Wallet& _wallet)
+: orderBook(_orderBook),
+  wallet(_wallet)
+{
+    currentTime = orderBook.getEarliestTime();
+    // the console is for the gateway's own messages, not every NEXT's price ranges
+    orderBook.setPrintPriceRanges(false);
+}
+
+OrderGateway::~OrderGateway()
+{
+    for (auto const& pair : connections)
+    {
+        close(pair.first);
+    }
+    if (listenFd >= 0)
+        close(listenFd);
+    if (epollFd >= 0)
+        close(epollFd);
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+}
+
+bool OrderGateway::listenUnix(std::string path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cout << "OrderGateway::listenUnix path too long " << path << std::endl;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 ||
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0 ||
+        !setNonBlocking(listenFd))
+    {
+        std::cout << "OrderGateway::listenUnix failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    unixPath = path;
+    return true;
+}
+
+bool OrderGateway::listenTcp(int port)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    if (listenFd < 0 ||
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0 ||
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0 ||
+        !setNonBlocking(listenFd))
+    {
+        std::cout << "OrderGateway::listenTcp failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool OrderGateway::listenOn(std::string address)
+{
+    if (!address.empty() && std::all_of(address.begin(), address.end(), [](unsigned char c) { return std::isdigit(c); }))
+    {
+        return listenTcp(std::stoi(address));
+    }
+    return listenUnix(address);
+}
+
+void OrderGateway::run()
+{
+    epollFd = epoll_create1(0);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) != 0)
+    {
+        std::cout << "OrderGateway::run epoll failed: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    PlacedThread placed{ThreadRole::gateway, "gateway"};
+    running = true;
+    epoll_event events[64];
+    while (running)
+    {
+        // wake up now and then to notice stop()
+        int n = epoll_wait(epollFd, events, 64, 100);
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listenFd)
+            {
+                acceptClients();
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end())
+                continue;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                ok = readClient(fd, it->second);
+            if (ok && (events[i].events & EPOLLOUT))
+                ok = writeClient(fd, it->second);
+            if (!ok)
+                closeClient(fd);
+        }
+    }
+}
+
+void OrderGateway::stop()
+{
+    running = false;
+}
+
+void OrderGateway::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+            return; // EAGAIN: no more waiting
+        setNonBlocking(fd);
+        int yes = 1;
+        // fails harmlessly on Unix-domain sockets
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        Connection connection;
+        connection.peer = peerName(fd);
+        connections[fd] = connection;
+    }
+}
+
+bool OrderGateway::readClient(int fd, Connection& connection)
+{
+    char buf[4096];
+    // a client that does not read its answers stops being read from
+    while (connection.output.size() - connection.outputSent <= maxPendingOutput)
+    {
+        ssize_t got = read(fd, buf, sizeof(buf));
+        if (got == 0)
+            return false; // client closed
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        connection.input.append(buf, got);
+
+        // answer each chunk's lines as it comes, so only a partial line is
+        // ever buffered
+        size_t start = 0;
+        size_t end;
+        while ((end = connection.input.find('\n', start)) != std::string::npos)
+        {
+            std::string line = connection.input.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            connection.output += handleLine(line, connection);
+            connection.output += '\n';
+            start = end + 1;
+        }
+        connection.input.erase(0, start);
+        if (connection.input.size() > maxLineLength)
+        {
+            std::cout << "OrderGateway::readClient dropping a client that sent a line over "
+                      << maxLineLength << " bytes" << std::endl;
+            return false;
+        }
+    }
+
+    return writeClient(fd, connection);
+}
+
+bool OrderGateway::writeClient(int fd, Connection& connection)
+{
+    while (connection.outputSent < connection.output.size())
+    {
+        ssize_t sent = write(fd, connection.output.data() + connection.outputSent,
+                             connection.output.size() - connection.outputSent);
+        if (sent > 0)
+        {
+            connection.outputSent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+    // drop what has been written once it is most of the buffer, so each
+    // byte is moved at most once on average
+    if (connection.outputSent == connection.output.size())
+    {
+        connection.output.clear();
+        connection.outputSent = 0;
+    }
+    else if (connection.outputSent > connection.output.size() / 2)
+    {
+        connection.output.erase(0, connection.outputSent);
+        connection.outputSent = 0;
+    }
+
+    // only ask to hear about writability while we have something to write,
+    // and stop reading requests while too many answers are waiting
+    size_t pending = connection.output.size() - connection.outputSent;
+    epoll_event ev{};
+    ev.events = pending > maxPendingOutput ? EPOLLOUT : pending > 0 ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+    return true;
+}
+
+void OrderGateway::closeClient(int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+std::string OrderGateway::handleLine(const std::string& line, Connection& connection)
+{
+    if (line.compare(0, 4, "ASK,") == 0)
+        return enterOrder(line.substr(4), OrderBookType::ask, connection);
+    if (line.compare(0, 4, "BID,") == 0)
+        return enterOrder(line.substr(4), OrderBookType::bid, connection);
+    if (line == "NEXT")
+        return nextTimeframe();
+    return "REJECT unknown command";
+}
+
+std::string OrderGateway::peerName(int fd)
+{
+    ucred cred{};
+    socklen_t length = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0 && cred.pid > 0)
+    {
+        return "uid=" + std::to_string(cred.uid);
+    }
+    sockaddr_in addr{};
+    length = sizeof(addr);
+    char text[INET_ADDRSTRLEN];
+    if (getpeername(fd, (sockaddr*)&addr, &length) == 0 && addr.sin_family == AF_INET &&
+        inet_ntop(AF_INET, &addr.sin_addr, text, sizeof(text)) != nullptr)
+    {
+        return text;
+    }
+    return "unknown";
+}
+
+std::string OrderGateway::enterOrder(const std::string& line, OrderBookType type, Connection& connection)
+{
+    if (rateLimiter != nullptr)
+    {
+        if (connection.account < 0)
+        {
+            auto it = peerClasses.find(connection.peer);
+            int classId = it == peerClasses.end() ? 0 : it->second;
+            connection.account = rateLimiter->getAccount(connection.peer, classId);
+        }
+        if (connection.account < 0 || !rateLimiter->tryAcquire(connection.account))
+        {
+            ++ordersRejected;
+            return "REJECT rate limited";
+        }
+    }
+    std::vector<std::string> tokens = CSVReader::tokenise(line, ',');
+    if (tokens.size() != 3)
+    {
+        ++ordersRejected;
+        return "REJECT bad input";
+    }
+    try
+    {
+        OrderBookEntry obe = CSVReader::stringsToOBE(tokens[1],
+                                                     tokens[2],
+                                                     currentTime,
+                                                     tokens[0],
+                                                     type);
+        obe.username = "simuser";
+        obe.orderId = orderBook.newOrderId();
+        if (!wallet.reserveOrder(obe))
+        {
+            ++ordersRejected;
+            return "REJECT insufficient funds";
+        }
+        orderBook.insertOrder(obe);
+        ++ordersAccepted;
+        return "OK " + std::to_string(obe.orderId);
+    }
+    catch (const std::exception& e)
+    {
+        ++ordersRejected;
+        return "REJECT bad input";
+    }
+}
+
+std::string OrderGateway::nextTimeframe()
+{
+    for (const std::string& p : orderBook.getKnownProducts())
+    {
+        std::vector<OrderBookEntry> sales = orderBook.matchAsksToBids(p, currentTime);
+        for (OrderBookEntry& sale : sales)
+        {
+            if (sale.username == "simuser")
+            {
+                wallet.processSale(sale);
+            }
+        }
+    }
+    wallet.releaseTimeframe(currentTime);
+    currentTime = orderBook.getNextTime(currentTime);
+    return "TIME " + currentTime;
+}
+
+void OrderGateway::setRateLimiter(OrderRateLimiter* limiter)
+{
+    rateLimiter = limiter;
+}
+
+void OrderGateway::setPeerClass(const std::string& peer, int classId)
+{
+    peerClasses[peer] = classId;
+}
+
+unsigned long OrderGateway::getOrdersAccepted() const
+{
+    return ordersAccepted;
+}
+
+unsigned long OrderGateway::getOrdersRejected() const
+{
+    return ordersRejected;
+}
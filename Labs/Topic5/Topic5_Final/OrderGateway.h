@@ -0,0 +1,104 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Wallet.h"
+#include "OrderRateLimiter.h"
+#include <atomic>
+#include <map>
+#include <string>
+
+/** A non-blocking, epoll-based order entry server for local clients,
+ * for use instead of the stdin menu. Clients connect over a Unix-domain
+ * socket or TCP on 127.0.0.1 and send one command per line:
+ *
+ *   ASK,ETH/BTC,0.02,0.5   -> "OK <orderId>" or "REJECT <reason>"
+ *   BID,ETH/BTC,0.02,0.5   -> "OK <orderId>" or "REJECT <reason>"
+ *   NEXT                   -> match this timeframe, "TIME <next timestamp>"
+ *
+ * Orders reserve their funds with Wallet::reserveOrder and are inserted at the
+ * current time as simuser, just like MerkelMain::enterAsk/enterBid.
+ * Everything runs on the thread that calls run(), so the book and wallet
+ * are never touched from two threads at once. The book stops printing
+ * its price ranges as it matches.
+ *
+ * With a rate limiter set, each order takes a token from its account
+ * before it is parsed, and "REJECT rate limited" if there is none.
+ * The account is the client's peer, which it cannot pick for itself:
+ * "uid=<uid>" over a Unix-domain socket and the address over TCP. Every
+ * connection from the same peer shares one bucket, reconnecting included,
+ * and a peer is in the default class unless setPeerClass says otherwise.
+ */
+class OrderGateway
+{
+    public:
+        OrderGateway(OrderBook& orderBook, Wallet& wallet);
+        ~OrderGateway();
+
+    /** listen on a Unix-domain socket at path, replacing any old socket file */
+        bool listenUnix(std::string path);
+    /** listen on 127.0.0.1:port */
+        bool listenTcp(int port);
+    /** listenTcp if address is all digits, otherwise listenUnix */
+        bool listenOn(std::string address);
+
+    /** serve clients until stop() is called */
+        void run();
+    /** safe to call from any thread, or a signal handler */
+        void stop();
+
+    /** limit the rate of orders per account from now on, or stop if nullptr */
+        void setRateLimiter(OrderRateLimiter* limiter);
+    /** put a peer, e.g. "uid=1000" or "127.0.0.1", in a rate limiter class.
+     * only takes effect if the peer has not entered an order yet */
+        void setPeerClass(const std::string& peer, int classId);
+
+        unsigned long getOrdersAccepted() const;
+        unsigned long getOrdersRejected() const;
+
+    /** a client that sends more than this without a newline is dropped */
+        static const size_t maxLineLength = 4096;
+    /** while more than this many bytes of answers wait for a client, its
+     * requests are left unread until it catches up */
+        static const size_t maxPendingOutput = 64 * 1024;
+
+    private:
+        struct Connection
+        {
+            std::string input;
+            std::string output;
+            /** how much of output has been written already */
+            size_t outputSent = 0;
+            /** who is on the other end, as named by peerName */
+            std::string peer;
+            /** rate limiter account, -1 until the first order */
+            int account = -1;
+        };
+
+        void acceptClients();
+    /** read what is available and answer any complete lines.
+     * returns false if the client has gone */
+        bool readClient(int fd, Connection& connection);
+    /** write as much pending output as the socket will take */
+        bool writeClient(int fd, Connection& connection);
+        void closeClient(int fd);
+        std::string handleLine(const std::string& line, Connection& connection);
+        std::string enterOrder(const std::string& line, OrderBookType type, Connection& connection);
+    /** the rate limiter account of a connected socket's peer */
+        static std::string peerName(int fd);
+        std::string nextTimeframe();
+
+        OrderBook& orderBook;
+        Wallet& wallet;
+        std::string currentTime;
+
+        int listenFd = -1;
+        int epollFd = -1;
+        std::string unixPath;
+        std::map<int, Connection> connections;
+        std::atomic<bool> running{false};
+        OrderRateLimiter* rateLimiter = nullptr;
+        std::map<std::string, int> peerClasses;
+
+        unsigned long ordersAccepted = 0;
+        unsigned long ordersRejected = 0;
+};
@@ -0,0 +1,257 @@
+#include "OrderQuery.h"
+#include "MarketDataFeed.h"
+#include <algorithm>
+#include <map>
+#include <thread>
+
+/** the group key packs bucket, product and type, so results sort by them.
+ * bucket counts from the earliest row's, and must fit in 48 bits */
+static uint64_t groupKey(uint64_t bucket, uint8_t product, uint8_t type)
+{
+    return (bucket << 16) | (uint64_t(product) << 8) | type;
+}
+
+static std::string typeName(OrderBookType type)
+{
+    switch (type)
+    {
+        case OrderBookType::bid: return "bid";
+        case OrderBookType::ask: return "ask";
+        case OrderBookType::asksale: return "asksale";
+        case OrderBookType::bidsale: return "bidsale";
+        default: return "unknown";
+    }
+}
+
+OrderQuery::OrderQuery()
+{
+
+}
+
+OrderQuery::OrderQuery(const OrderBook& orderBook)
+{
+    for (const OrderSegment& segment : orderBook.getHistory())
+    {
+        addSegment(segment);
+    }
+    addOrders(orderBook.getAllOrders());
+}
+
+uint8_t OrderQuery::productCode(const std::string& product)
+{
+    auto it = productIndex.find(product);
+    if (it != productIndex.end())
+        return it->second;
+    if (products.size() > 255)
+    {
+        // the codes are one byte, like OrderSegment's
+        throw std::exception{};
+    }
+    products.push_back(product);
+    productIndex[product] = products.size() - 1;
+    return products.size() - 1;
+}
+
+void OrderQuery::addRow(uint64_t micros, uint8_t product, OrderBookType type, double price, double amount)
+{
+    times.push_back(micros);
+    earliestMicros = std::min(earliestMicros, micros);
+    latestMicros = std::max(latestMicros, micros);
+    productCodes.push_back(product);
+    typeCodes.push_back(static_cast<uint8_t>(type));
+    prices.push_back(price);
+    amounts.push_back(amount);
+}
+
+void OrderQuery::addOrders(const std::vector<OrderBookEntry>& orders)
+{
+    // orders come in runs with the same timestamp, so convert each run once
+    std::string lastTimestamp;
+    uint64_t micros = 0;
+    for (const OrderBookEntry& e : orders)
+    {
+        if (e.timestamp != lastTimestamp)
+        {
+            lastTimestamp = e.timestamp;
+            micros = MarketDataFeed::timestampToMicros(e.timestamp);
+        }
+        addRow(micros, productCode(e.product), e.orderType, e.price, e.amount);
+    }
+}
+
+void OrderQuery::addSegment(const OrderSegment& segment)
+{
+    std::vector<uint8_t> codes;
+    for (const std::string& product : segment.getProducts())
+    {
+        codes.push_back(productCode(product));
+    }
+    OrderSegment::Reader reader = segment.reader();
+    OrderRecord record;
+    while (reader.next(record))
+    {
+        addRow(record.timeMicros, codes[record.product], record.orderType, record.price, record.amount);
+    }
+}
+
+size_t OrderQuery::size() const
+{
+    return times.size();
+}
+
+std::vector<QueryRow> OrderQuery::run(const QuerySpec& spec, unsigned int threads) const
+{
+    uint64_t firstBucket = 0;
+    if (spec.bucketMicros > 0 && !times.empty())
+    {
+        firstBucket = earliestMicros / spec.bucketMicros;
+        if ((latestMicros / spec.bucketMicros - firstBucket) >> 48 != 0)
+        {
+            // too narrow for the span of the rows to fit in the group key
+            throw std::exception{};
+        }
+    }
+
+    // 1 for every product and type the filters let through
+    std::vector<uint8_t> productMask(256, spec.products.empty() ? 1 : 0);
+    for (const std::string& product : spec.products)
+    {
+        auto it = productIndex.find(product);
+        if (it != productIndex.end())
+            productMask[it->second] = 1;
+    }
+    std::vector<uint8_t> typeMask(256, spec.types.empty() ? 1 : 0);
+    for (OrderBookType type : spec.types)
+    {
+        typeMask[static_cast<uint8_t>(type)] = 1;
+    }
+
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // not worth a thread for less than a few batches
+    threads = std::max<size_t>(1, std::min<size_t>(threads, size() / (4 * batchSize)));
+
+    std::vector<GroupMap> partials(threads);
+    std::vector<std::thread> workers;
+    size_t chunk = (size() + threads - 1) / threads;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        size_t begin = std::min(size(), t * chunk);
+        size_t end = std::min(size(), begin + chunk);
+        if (t + 1 == threads)
+        {
+            runPartition(spec, productMask, typeMask, firstBucket, begin, end, partials[t]);
+        }
+        else
+        {
+            workers.emplace_back(&OrderQuery::runPartition, this, std::cref(spec), std::cref(productMask),
+                                 std::cref(typeMask), firstBucket, begin, end, std::ref(partials[t]));
+        }
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::map<uint64_t, Aggregate> merged;
+    for (const GroupMap& partial : partials)
+    {
+        for (auto const& pair : partial)
+        {
+            merged[pair.first].merge(pair.second);
+        }
+    }
+
+    std::vector<QueryRow> rows;
+    for (auto const& pair : merged)
+    {
+        const Aggregate& a = pair.second;
+        QueryRow row;
+        if (spec.byProduct)
+            row.product = products[(pair.first >> 8) & 0xff];
+        if (spec.byType)
+            row.type = typeName(static_cast<OrderBookType>(pair.first & 0xff));
+        if (spec.bucketMicros > 0)
+            row.bucket = MarketDataFeed::microsToTimestamp(((pair.first >> 16) + firstBucket) * spec.bucketMicros);
+        row.count = a.count;
+        row.sumAmount = a.sumAmount;
+        row.sumNotional = a.sumNotional;
+        row.sumPrice = a.sumPrice;
+        row.minPrice = a.minPrice;
+        row.maxPrice = a.maxPrice;
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+void OrderQuery::runPartition(const QuerySpec& spec,
+                              const std::vector<uint8_t>& productMask,
+                              const std::vector<uint8_t>& typeMask,
+                              uint64_t firstBucket,
+                              size_t begin,
+                              size_t end,
+                              GroupMap& groups) const
+{
+    uint32_t selection[batchSize];
+    uint64_t keys[batchSize];
+    uint64_t lastKey = 0;
+    Aggregate* last = nullptr;
+
+    for (size_t batch = begin; batch < end; batch += batchSize)
+    {
+        size_t n = std::min(batchSize, end - batch);
+        const uint64_t* t = times.data() + batch;
+        const uint8_t* p = productCodes.data() + batch;
+        const uint8_t* y = typeCodes.data() + batch;
+        const double* price = prices.data() + batch;
+        const double* amount = amounts.data() + batch;
+
+        // filter: no branches, every row is written and kept rows advance
+        size_t selected = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            selection[selected] = i;
+            selected += productMask[p[i]] & typeMask[y[i]] &
+                        (t[i] >= spec.fromMicros) & (t[i] < spec.toMicros);
+        }
+
+        // group keys for the selected rows
+        for (size_t j = 0; j < selected; ++j)
+        {
+            uint32_t i = selection[j];
+            uint64_t bucket = spec.bucketMicros > 0 ? t[i] / spec.bucketMicros - firstBucket : 0;
+            keys[j] = groupKey(bucket, spec.byProduct ? p[i] : 0, spec.byType ? y[i] : 0);
+        }
+
+        // aggregate. rows are in time order, so keys repeat in runs and
+        // the last group looked up is usually the one we want
+        for (size_t j = 0; j < selected; ++j)
+        {
+            uint32_t i = selection[j];
+            if (last == nullptr || keys[j] != lastKey)
+            {
+                lastKey = keys[j];
+                last = &groups[lastKey];
+            }
+            Aggregate& a = *last;
+            ++a.count;
+            a.sumAmount += amount[i];
+            a.sumNotional += price[i] * amount[i];
+            a.sumPrice += price[i];
+            a.minPrice = std::min(a.minPrice, price[i]);
+            a.maxPrice = std::max(a.maxPrice, price[i]);
+        }
+    }
+}
+
+void OrderQuery::Aggregate::merge(const Aggregate& other)
+{
+    count += other.count;
+    sumAmount += other.sumAmount;
+    sumNotional += other.sumNotional;
+    sumPrice += other.sumPrice;
+    minPrice = std::min(minPrice, other.minPrice);
+    maxPrice = std::max(maxPrice, other.maxPrice);
+}
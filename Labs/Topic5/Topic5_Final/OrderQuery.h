@@ -0,0 +1,114 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "OrderSegment.h"
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** What to select and how to group it. Every filter is optional. */
+struct QuerySpec
+{
+    /** only these products; empty means every product */
+    std::vector<std::string> products;
+    /** only these order types; empty means every type */
+    std::vector<OrderBookType> types;
+    /** only orders in [fromMicros, toMicros) */
+    uint64_t fromMicros = 0;
+    uint64_t toMicros = std::numeric_limits<uint64_t>::max();
+
+    bool byProduct = false;
+    bool byType = false;
+    /** group into time buckets this many microseconds wide. 0 = no buckets */
+    uint64_t bucketMicros = 0;
+};
+
+/** One group of a query result. Fields that were not grouped on are empty. */
+struct QueryRow
+{
+    std::string product;
+    std::string type;
+    /** start of the time bucket, as a dataset timestamp */
+    std::string bucket;
+
+    unsigned long count = 0;
+    double sumAmount = 0;
+    /** sum of price * amount */
+    double sumNotional = 0;
+    double sumPrice = 0;
+    double minPrice = 0;
+    double maxPrice = 0;
+
+    double avgPrice() const { return count == 0 ? 0 : sumPrice / count; }
+    double vwap() const { return sumAmount == 0 ? 0 : sumNotional / sumAmount; }
+};
+
+/** Ad-hoc queries over order history, e.g. bid volume per product per hour.
+ *
+ * Orders are copied once into plain columns (price, amount, time, product
+ * and type codes). A query splits the rows into contiguous time partitions,
+ * one per thread, and runs each through the same operators a batch of rows
+ * at a time: the filter writes a selection vector, then the group keys for
+ * the selected rows are computed, then they are folded into per-group
+ * count, sum, min, max, average and VWAP. Partition results are merged at
+ * the end.
+ */
+class OrderQuery
+{
+    public:
+        OrderQuery();
+    /** the compressed history and then the live orders of the book */
+        OrderQuery(const OrderBook& orderBook);
+
+    /** append rows. history should be added oldest first */
+        void addOrders(const std::vector<OrderBookEntry>& orders);
+        void addSegment(const OrderSegment& segment);
+
+    /** rows are ordered by bucket, then product, then type.
+     * threads = 0 means use all cores. throws if bucketMicros is so
+     * narrow that the rows span more than 2^48 buckets */
+        std::vector<QueryRow> run(const QuerySpec& spec, unsigned int threads = 0) const;
+
+        size_t size() const;
+
+    private:
+        /** running aggregates for one group */
+        struct Aggregate
+        {
+            unsigned long count = 0;
+            double sumAmount = 0;
+            double sumNotional = 0;
+            double sumPrice = 0;
+            double minPrice = std::numeric_limits<double>::max();
+            double maxPrice = std::numeric_limits<double>::lowest();
+
+            void merge(const Aggregate& other);
+        };
+        typedef std::unordered_map<uint64_t, Aggregate> GroupMap;
+
+        uint8_t productCode(const std::string& product);
+        void addRow(uint64_t micros, uint8_t product, OrderBookType type, double price, double amount);
+        /** filter, key and aggregate rows [begin, end) in batches */
+        void runPartition(const QuerySpec& spec,
+                          const std::vector<uint8_t>& productMask,
+                          const std::vector<uint8_t>& typeMask,
+                          uint64_t firstBucket,
+                          size_t begin,
+                          size_t end,
+                          GroupMap& groups) const;
+
+        static constexpr size_t batchSize = 1024;
+
+        std::vector<uint64_t> times;
+        std::vector<uint8_t> productCodes;
+        std::vector<uint8_t> typeCodes;
+        std::vector<double> prices;
+        std::vector<double> amounts;
+        std::vector<std::string> products;
+        std::unordered_map<std::string, uint8_t> productIndex;
+        /** the range of times, so bucket numbers can start from the first */
+        uint64_t earliestMicros = std::numeric_limits<uint64_t>::max();
+        uint64_t latestMicros = 0;
+};
@@ -0,0 +1,122 @@
+#include "OrderRateLimiter.h"
+#include <algorithm>
+#include <chrono>
+
+OrderRateLimiter::OrderRateLimiter(size_t _maxAccounts)
+: maxAccounts(_maxAccounts), buckets(new Bucket[_maxAccounts])
+{
+
+}
+
+int OrderRateLimiter::addClass(const RateLimitClass& limits)
+{
+    if (limits.ordersPerSecond <= 0 || limits.burst < 1)
+        throw std::exception{};
+    std::lock_guard<std::mutex> lock{mutex};
+    classes.push_back(limits);
+    return static_cast<int>(classes.size() - 1);
+}
+
+int OrderRateLimiter::findClass(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    for (size_t i = 0; i < classes.size(); ++i)
+    {
+        if (classes[i].name == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int OrderRateLimiter::getAccount(const std::string& name, int classId)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = accountIds.find(name);
+    if (it != accountIds.end())
+        return it->second;
+    if (classId < 0 || classId >= static_cast<int>(classes.size()))
+        throw std::exception{};
+    size_t id = accountCount.load(std::memory_order_relaxed);
+    if (id == maxAccounts)
+        return -1;
+
+    const RateLimitClass& limits = classes[classId];
+    Bucket& bucket = buckets[id];
+    bucket.interval = static_cast<int64_t>(1e9 / limits.ordersPerSecond);
+    bucket.tolerance = static_cast<int64_t>((limits.burst - 1) * bucket.interval);
+    bucket.classId = classId;
+    accountIds[name] = static_cast<int>(id);
+    // publishes the bucket's settings along with the new count
+    accountCount.store(id + 1, std::memory_order_release);
+    return static_cast<int>(id);
+}
+
+bool OrderRateLimiter::tryAcquire(int account)
+{
+    return tryAcquire(account, nowNanos());
+}
+
+bool OrderRateLimiter::tryAcquire(int account, int64_t now)
+{
+    if (account < 0 || static_cast<size_t>(account) >= accountCount.load(std::memory_order_acquire))
+        throw std::exception{};
+    Bucket& bucket = buckets[account];
+    int64_t fullAt = bucket.fullAt.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // each token taken pushes fullAt one interval further out, so the
+        // bucket is empty once fullAt is more than burst - 1 intervals away
+        if (now < fullAt - bucket.tolerance)
+        {
+            bucket.rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        int64_t next = std::max(fullAt, now) + bucket.interval;
+        if (bucket.fullAt.compare_exchange_weak(fullAt, next, std::memory_order_relaxed))
+        {
+            bucket.accepted.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
+
+RateLimitCounters OrderRateLimiter::getAccountCounters(int account) const
+{
+    if (account < 0 || static_cast<size_t>(account) >= accountCount.load(std::memory_order_acquire))
+        throw std::exception{};
+    RateLimitCounters counters;
+    counters.accepted = buckets[account].accepted.load(std::memory_order_relaxed);
+    counters.rejected = buckets[account].rejected.load(std::memory_order_relaxed);
+    return counters;
+}
+
+RateLimitCounters OrderRateLimiter::getClassCounters(int classId) const
+{
+    RateLimitCounters counters;
+    size_t count = accountCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (buckets[i].classId != classId)
+            continue;
+        counters.accepted += buckets[i].accepted.load(std::memory_order_relaxed);
+        counters.rejected += buckets[i].rejected.load(std::memory_order_relaxed);
+    }
+    return counters;
+}
+
+const std::vector<RateLimitClass>& OrderRateLimiter::getClasses() const
+{
+    return classes;
+}
+
+size_t OrderRateLimiter::getAccountCount() const
+{
+    return accountCount.load(std::memory_order_acquire);
+}
+
+int64_t OrderRateLimiter::nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
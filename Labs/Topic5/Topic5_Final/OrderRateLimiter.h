@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** how fast one class of user may enter orders */
+struct RateLimitClass
+{
+    std::string name;
+    /** sustained rate */
+    double ordersPerSecond;
+    /** how many orders may arrive at once after a quiet spell */
+    double burst;
+};
+
+/** order and reject counts for one account or one class */
+struct RateLimitCounters
+{
+    unsigned long accepted = 0;
+    unsigned long rejected = 0;
+};
+
+/** A token bucket per account, checked before an order is entered.
+ *
+ * Each bucket is kept as the single time at which it would next be full
+ * (the generic cell rate algorithm, which behaves exactly like a token
+ * bucket). Taking a token is one compare-and-swap of that time, so any
+ * number of threads can enter orders for any accounts without a lock, and
+ * a rejected order is just a load and a compare. Buckets sit on their own
+ * cache lines so busy accounts do not slow each other down.
+ *
+ * Classes and accounts are added under a mutex. Accounts are kept in a
+ * fixed-size array, so the id returned by getAccount stays valid and can
+ * be used from any thread.
+ */
+class OrderRateLimiter
+{
+    public:
+        OrderRateLimiter(size_t maxAccounts = 4096);
+
+    /** add a class and return its id. the first class added is the default */
+        int addClass(const RateLimitClass& limits);
+    /** the id of a class, or -1 if there is none by that name */
+        int findClass(const std::string& name) const;
+    /** the id of a named account, adding it in classId if it is new.
+     * an existing account keeps its class. returns -1 once full */
+        int getAccount(const std::string& name, int classId = 0);
+
+    /** take a token from the account's bucket if there is one */
+        bool tryAcquire(int account);
+        bool tryAcquire(int account, int64_t nowNanos);
+
+        RateLimitCounters getAccountCounters(int account) const;
+    /** totals over every account in the class */
+        RateLimitCounters getClassCounters(int classId) const;
+        const std::vector<RateLimitClass>& getClasses() const;
+        size_t getAccountCount() const;
+
+    /** the clock tryAcquire uses, in nanoseconds */
+        static int64_t nowNanos();
+
+    private:
+        struct alignas(64) Bucket
+        {
+            /** when the bucket will next be full; it is full at any time after */
+            std::atomic<int64_t> fullAt{0};
+            /** nanoseconds each token takes to come back */
+            int64_t interval = 0;
+            /** how far ahead of now fullAt may get, i.e. (burst - 1) tokens */
+            int64_t tolerance = 0;
+            int classId = 0;
+            std::atomic<unsigned long> accepted{0};
+            std::atomic<unsigned long> rejected{0};
+        };
+
+        size_t maxAccounts;
+        std::unique_ptr<Bucket[]> buckets;
+        std::atomic<size_t> accountCount{0};
+
+        mutable std::mutex mutex;
+        std::vector<RateLimitClass> classes;
+        std::map<std::string, int> accountIds;
+};
@@ -0,0 +1,260 @@
+#include "OrderSegment.h"
+#include "MarketDataFeed.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// prices and amounts are stored in units of 1e-8
+static const double fixedScale = 1e8;
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static uint64_t getVarint(const std::vector<uint8_t>& in, size_t& pos)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    while (in[pos] & 0x80)
+    {
+        value |= uint64_t(in[pos++] & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= uint64_t(in[pos++]) << shift;
+    return value;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+/** x in fixed point, if that round trips exactly */
+static bool toFixed(double x, int64_t& fixed)
+{
+    double scaled = x * fixedScale;
+    if (!(std::fabs(scaled) < 4e18))
+        return false;
+    fixed = std::llround(scaled);
+    return fixed / fixedScale == x;
+}
+
+/** a fixed-point value relative to base, tagged 0, or the raw double tagged 1 */
+static void putNumber(std::vector<uint8_t>& out, double x, int64_t base)
+{
+    int64_t fixed;
+    if (toFixed(x, fixed))
+    {
+        putVarint(out, zigzag(fixed - base) << 1);
+        return;
+    }
+    putVarint(out, 1);
+    uint8_t bytes[sizeof(double)];
+    std::memcpy(bytes, &x, sizeof(double));
+    out.insert(out.end(), bytes, bytes + sizeof(double));
+}
+
+static double getNumber(const std::vector<uint8_t>& in, size_t& pos, int64_t base)
+{
+    uint64_t tagged = getVarint(in, pos);
+    if (tagged & 1)
+    {
+        double x;
+        std::memcpy(&x, &in[pos], sizeof(double));
+        pos += sizeof(double);
+        return x;
+    }
+    return (unzigzag(tagged >> 1) + base) / fixedScale;
+}
+
+unsigned int OrderSegment::lookup(std::vector<std::string>& dictionary, const std::string& value)
+{
+    for (size_t i = 0; i < dictionary.size(); ++i)
+    {
+        if (dictionary[i] == value)
+            return i;
+    }
+    dictionary.push_back(value);
+    return dictionary.size() - 1;
+}
+
+OrderSegment::OrderSegment(const OrderBookEntry* first, const OrderBookEntry* last)
+{
+    rows = last - first;
+    if (rows == 0)
+    {
+        return;
+    }
+    firstTimestamp = first->timestamp;
+    lastTimestamp = (last - 1)->timestamp;
+    firstMicros = MarketDataFeed::timestampToMicros(firstTimestamp);
+
+    // first pass: dictionaries, and the lowest price per product as its base
+    for (const OrderBookEntry* e = first; e != last; ++e)
+    {
+        unsigned int product = lookup(products, e->product);
+        lookup(users, e->username);
+        if (priceBases.size() < products.size())
+            priceBases.push_back(std::numeric_limits<int64_t>::max());
+        int64_t fixed;
+        if (toFixed(e->price, fixed) && fixed < priceBases[product])
+            priceBases[product] = fixed;
+    }
+    for (int64_t& base : priceBases)
+    {
+        if (base == std::numeric_limits<int64_t>::max())
+            base = 0;
+    }
+    if (products.size() > 256 || users.size() > 256)
+    {
+        throw std::exception{};
+    }
+
+    uint64_t previousTime = firstMicros;
+    unsigned long previousId = 0;
+    std::string previousTimestamp = firstTimestamp;
+    for (const OrderBookEntry* e = first; e != last; ++e)
+    {
+        // runs of orders share a timestamp, so only convert when it changes
+        uint64_t time = previousTime;
+        if (e->timestamp != previousTimestamp)
+        {
+            time = MarketDataFeed::timestampToMicros(e->timestamp);
+            previousTimestamp = e->timestamp;
+        }
+        if (time < previousTime || MarketDataFeed::microsToTimestamp(time) != e->timestamp)
+        {
+            // not in time order, or not a timestamp we can rebuild exactly
+            throw std::exception{};
+        }
+        putVarint(times, time - previousTime);
+        previousTime = time;
+
+        unsigned int product = lookup(products, e->product);
+        productCodes.push_back(uint8_t(product));
+        typeCodes.push_back(uint8_t(e->orderType));
+        userCodes.push_back(uint8_t(lookup(users, e->username)));
+        putNumber(prices, e->price, priceBases[product]);
+        putNumber(amounts, e->amount, 0);
+        putVarint(orderIds, zigzag(int64_t(e->orderId - previousId)));
+        previousId = e->orderId;
+    }
+
+    times.shrink_to_fit();
+    prices.shrink_to_fit();
+    amounts.shrink_to_fit();
+    orderIds.shrink_to_fit();
+}
+
+OrderSegment::Reader::Reader(const OrderSegment& _segment)
+: segment(_segment),
+  time(_segment.firstMicros)
+{
+
+}
+
+bool OrderSegment::Reader::next(OrderRecord& record)
+{
+    if (row == segment.rows)
+    {
+        return false;
+    }
+    time += getVarint(segment.times, timePos);
+    orderId += unzigzag(getVarint(segment.orderIds, idPos));
+
+    record.timeMicros = time;
+    record.product = segment.productCodes[row];
+    record.orderType = static_cast<OrderBookType>(segment.typeCodes[row]);
+    record.user = segment.userCodes[row];
+    record.price = getNumber(segment.prices, pricePos, segment.priceBases[record.product]);
+    record.amount = getNumber(segment.amounts, amountPos, 0);
+    record.orderId = orderId;
+    ++row;
+    return true;
+}
+
+OrderSegment::Reader OrderSegment::reader() const
+{
+    return Reader{*this};
+}
+
+size_t OrderSegment::size() const
+{
+    return rows;
+}
+
+size_t OrderSegment::getCompressedBytes() const
+{
+    size_t bytes = sizeof(OrderSegment) + times.size() + productCodes.size() + typeCodes.size()
+                 + userCodes.size() + prices.size() + amounts.size() + orderIds.size()
+                 + priceBases.size() * sizeof(int64_t);
+    for (const std::string& s : products)
+        bytes += sizeof(std::string) + s.size();
+    for (const std::string& s : users)
+        bytes += sizeof(std::string) + s.size();
+    return bytes;
+}
+
+const std::string& OrderSegment::getFirstTimestamp() const
+{
+    return firstTimestamp;
+}
+
+const std::string& OrderSegment::getLastTimestamp() const
+{
+    return lastTimestamp;
+}
+
+const std::vector<std::string>& OrderSegment::getProducts() const
+{
+    return products;
+}
+
+const std::vector<std::string>& OrderSegment::getUsers() const
+{
+    return users;
+}
+
+int OrderSegment::findProduct(const std::string& product) const
+{
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        if (products[i] == product)
+            return i;
+    }
+    return -1;
+}
+
+std::vector<OrderBookEntry> OrderSegment::decompress() const
+{
+    std::vector<OrderBookEntry> entries;
+    entries.reserve(rows);
+    Reader r = reader();
+    OrderRecord record;
+    uint64_t lastMicros = 0;
+    std::string timestamp;
+    while (r.next(record))
+    {
+        if (timestamp.empty() || record.timeMicros != lastMicros)
+        {
+            timestamp = MarketDataFeed::microsToTimestamp(record.timeMicros);
+            lastMicros = record.timeMicros;
+        }
+        entries.push_back(OrderBookEntry{record.price, record.amount, timestamp,
+                                         products[record.product], record.orderType,
+                                         users[record.user]});
+        entries.back().orderId = record.orderId;
+    }
+    return entries;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** One order as decoded from an OrderSegment, with no strings: product
+ * and user are indexes into the segment's dictionaries */
+struct OrderRecord
+{
+    uint64_t timeMicros;
+    unsigned int product;
+    OrderBookType orderType;
+    double price;
+    double amount;
+    unsigned long orderId;
+    unsigned int user;
+};
+
+/** An immutable, compressed block of past orders, stored column by column:
+ *  - timestamps as varint deltas in microseconds
+ *  - product, type and username as one-byte dictionary codes
+ *  - prices as zigzag varints of fixed-point (1e-8) values relative to a
+ *    per-product base, amounts as fixed-point varints; a value that does
+ *    not survive fixed point is stored as a raw double instead, so the
+ *    round trip is always exact
+ *  - order ids as varint deltas
+ * Scans decode one row at a time through a Reader, so a segment never
+ * has to be expanded back into OrderBookEntry objects to be queried.
+ */
+class OrderSegment
+{
+    public:
+    /** compress [first, last), which must be in time order.
+     * throws std::exception if a timestamp is not in the dataset's format
+     * (it would not come back exactly) or there are over 256 products or users */
+        OrderSegment(const OrderBookEntry* first, const OrderBookEntry* last);
+
+    /** walks the rows of a segment in order */
+        class Reader
+        {
+            public:
+                Reader(const OrderSegment& segment);
+            /** decode the next row into record. false once all rows are read */
+                bool next(OrderRecord& record);
+
+            private:
+                const OrderSegment& segment;
+                size_t row = 0;
+                size_t timePos = 0;
+                size_t pricePos = 0;
+                size_t amountPos = 0;
+                size_t idPos = 0;
+                uint64_t time;
+                unsigned long orderId = 0;
+        };
+
+        Reader reader() const;
+        size_t size() const;
+    /** bytes used by the columns and dictionaries */
+        size_t getCompressedBytes() const;
+        const std::string& getFirstTimestamp() const;
+        const std::string& getLastTimestamp() const;
+        const std::vector<std::string>& getProducts() const;
+        const std::vector<std::string>& getUsers() const;
+    /** code for product in this segment, or -1 if it has no orders for it */
+        int findProduct(const std::string& product) const;
+
+    /** rebuild the orders exactly as they were */
+        std::vector<OrderBookEntry> decompress() const;
+
+    private:
+        static unsigned int lookup(std::vector<std::string>& dictionary, const std::string& value);
+
+        size_t rows = 0;
+        std::string firstTimestamp;
+        std::string lastTimestamp;
+        uint64_t firstMicros = 0;
+
+        std::vector<uint8_t> times;
+        std::vector<uint8_t> productCodes;
+        std::vector<uint8_t> typeCodes;
+        std::vector<uint8_t> userCodes;
+        std::vector<uint8_t> prices;
+        std::vector<uint8_t> amounts;
+        std::vector<uint8_t> orderIds;
+
+        std::vector<std::string> products;
+        std::vector<std::string> users;
+    /** fixed-point price base for each product code */
+        std::vector<int64_t> priceBases;
+};
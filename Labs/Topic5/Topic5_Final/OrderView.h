@@ -0,0 +1,103 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <cstddef>
+#include <string>
+#include <utility>
+
+/** Non-owning ranges over the orders held by an OrderBook. Nothing is
+ * copied, so they are only valid until the book next changes.
+ */
+
+/** a contiguous run of orders, e.g. one timeframe */
+class OrderSpan
+{
+    public:
+        OrderSpan(const OrderBookEntry* _first, const OrderBookEntry* _last)
+        : first(_first),
+          last(_last)
+        {
+        }
+
+        const OrderBookEntry* begin() const { return first; }
+        const OrderBookEntry* end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+        const OrderBookEntry& operator[](size_t i) const { return first[i]; }
+
+    private:
+        const OrderBookEntry* first;
+        const OrderBookEntry* last;
+};
+
+/** the orders in a span with a given type and product.
+ * the filter is applied while iterating, so making one is free */
+class OrderView
+{
+    public:
+        class iterator
+        {
+            public:
+                iterator(const OrderBookEntry* _current, const OrderView& _view)
+                : current(_current),
+                  view(_view)
+                {
+                    skip();
+                }
+
+                const OrderBookEntry& operator*() const { return *current; }
+                const OrderBookEntry* operator->() const { return current; }
+                iterator& operator++()
+                {
+                    ++current;
+                    skip();
+                    return *this;
+                }
+                bool operator==(const iterator& other) const { return current == other.current; }
+                bool operator!=(const iterator& other) const { return current != other.current; }
+
+            private:
+                void skip()
+                {
+                    while (current != view.span.end() && !view.matches(*current))
+                        ++current;
+                }
+
+                const OrderBookEntry* current;
+                const OrderView& view;
+        };
+
+        OrderView(OrderSpan _span, OrderBookType _type, std::string _product)
+        : span(_span),
+          type(_type),
+          product(std::move(_product))
+        {
+        }
+
+        iterator begin() const { return iterator{span.begin(), *this}; }
+        iterator end() const { return iterator{span.end(), *this}; }
+        bool empty() const { return begin() == end(); }
+    /** counts the matching orders, so this walks the span */
+        size_t size() const
+        {
+            size_t n = 0;
+            for (const OrderBookEntry& e : span)
+            {
+                if (matches(e))
+                    ++n;
+            }
+            return n;
+        }
+
+        bool matches(const OrderBookEntry& e) const
+        {
+            return e.orderType == type && e.product == product;
+        }
+
+    private:
+        OrderSpan span;
+        OrderBookType type;
+    /** a copy, so a temporary product name is safe. product names fit
+     * in the small-string buffer, so this does not allocate */
+        std::string product;
+};
@@ -0,0 +1,92 @@
+#include "ParallelReplay.h"
+#include "ThreadPlacement.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+ParallelReplay::ParallelReplay(const OrderBook& _orderBook)
+: orderBook(_orderBook)
+{
+
+}
+
+ReplayResult ParallelReplay::run(Wallet& wallet, unsigned int threads)
+{
+    ReplayResult result;
+    std::vector<OrderSpan> frames = orderBook.getTimeframes();
+    std::vector<MatchedTimeframe> matched(frames.size());
+    result.timeframes = frames.size();
+
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<unsigned int>(threads, std::max<size_t>(1, frames.size()));
+    result.threads = threads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // match: every thread takes the next timeframe nobody has started
+    std::atomic<size_t> next{0};
+    auto worker = [this, &frames, &matched, &next]()
+    {
+        MatchArena arena;
+        for (size_t i = next++; i < frames.size(); i = next++)
+        {
+            matchTimeframe(frames[i], arena, matched[i]);
+            arena.reset();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        workers.emplace_back([&worker, i]
+        {
+            PlacedThread placed{ThreadRole::matcher, "replay" + std::to_string(i), static_cast<int>(i)};
+            worker();
+        });
+    }
+    worker();
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+
+    auto matchedAt = std::chrono::steady_clock::now();
+
+    // settle: in timestamp order, on this thread
+    for (MatchedTimeframe& frame : matched)
+    {
+        result.fills += frame.fills;
+        for (const Fill& fill : frame.walletFills)
+        {
+            wallet.processSale(fill.toSale());
+            ++result.walletFills;
+        }
+        wallet.releaseTimeframe(frame.timestamp);
+    }
+
+    auto settledAt = std::chrono::steady_clock::now();
+    result.matchSeconds = std::chrono::duration<double>(matchedAt - start).count();
+    result.settleSeconds = std::chrono::duration<double>(settledAt - matchedAt).count();
+    return result;
+}
+
+void ParallelReplay::matchTimeframe(OrderSpan frame, MatchArena& arena, MatchedTimeframe& matched) const
+{
+    matched.timestamp = frame[0].timestamp;
+    for (const std::string& product : orderBook.getKnownProducts())
+    {
+        std::pmr::vector<Fill> fills{&arena};
+        orderBook.matchProduct(product, frame, arena, fills);
+        matched.fills += fills.size();
+        for (const Fill& fill : fills)
+        {
+            if (fill.ask->username == "simuser" || fill.bid->username == "simuser")
+            {
+                matched.walletFills.push_back(fill);
+            }
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Wallet.h"
+#include <string>
+#include <vector>
+
+/** what a replay did and how long each half took */
+struct ReplayResult
+{
+    size_t timeframes = 0;
+    unsigned long fills = 0;
+    /** fills that involved simuser and so changed the wallet */
+    unsigned long walletFills = 0;
+    double matchSeconds = 0;
+    double settleSeconds = 0;
+    unsigned int threads = 0;
+};
+
+/** Replays every timeframe in the book once, as if Continue were pressed
+ * until the end of the file.
+ *
+ * Orders only ever match within their own timestamp, so timeframes do not
+ * depend on each other for matching and are matched in parallel, each
+ * thread with its own MatchArena. Only the wallet has to see the fills in
+ * order, so they are kept per timeframe and settled afterwards in
+ * timestamp order, releasing each timeframe's leftover reservations as
+ * gotoNextTimeframe does.
+ */
+class ParallelReplay
+{
+    public:
+        ParallelReplay(const OrderBook& orderBook);
+
+    /** threads = 0 means use all cores; 1 is the plain sequential replay */
+        ReplayResult run(Wallet& wallet, unsigned int threads = 0);
+
+    private:
+        /** what settlement needs from one matched timeframe */
+        struct MatchedTimeframe
+        {
+            std::string timestamp;
+            unsigned long fills = 0;
+            /** only the fills the wallet cares about */
+            std::vector<Fill> walletFills;
+        };
+
+        void matchTimeframe(OrderSpan frame, MatchArena& arena, MatchedTimeframe& matched) const;
+
+        const OrderBook& orderBook;
+};
@@ -0,0 +1,141 @@
+#include "Profiler.h"
+#include <iomanip>
+#include <sstream>
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+{
+    reset();
+}
+
+void Profiler::record(ProfileSection section, uint64_t nanos)
+{
+    SectionStats& s = sections[static_cast<int>(section)];
+    s.calls.fetch_add(1, std::memory_order_relaxed);
+    s.totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+
+    uint64_t max = s.maxNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !s.maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed))
+    {
+    }
+
+    int bucket = 0;
+    while (bucket < bucketCount - 1 && (nanos >> (bucket + 1)) != 0)
+    {
+        ++bucket;
+    }
+    s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::addItems(ProfileSection section, uint64_t items)
+{
+    sections[static_cast<int>(section)].items.fetch_add(items, std::memory_order_relaxed);
+}
+
+void Profiler::reset()
+{
+    for (SectionStats& s : sections)
+    {
+        s.calls = 0;
+        s.items = 0;
+        s.totalNanos = 0;
+        s.maxNanos = 0;
+        for (std::atomic<uint64_t>& b : s.buckets)
+        {
+            b = 0;
+        }
+    }
+}
+
+const char* Profiler::sectionName(ProfileSection section)
+{
+    switch (section)
+    {
+        case ProfileSection::parse: return "parse";
+        case ProfileSection::index: return "index";
+        case ProfileSection::match: return "match";
+        case ProfileSection::execute: return "execute";
+        case ProfileSection::settle: return "settle";
+        case ProfileSection::mark: return "mark";
+        case ProfileSection::print: return "print";
+        default: return "unknown";
+    }
+}
+
+uint64_t Profiler::percentile(const SectionStats& stats, double fraction) const
+{
+    uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+    uint64_t seen = 0;
+    for (int i = 0; i < bucketCount; ++i)
+    {
+        seen += stats.buckets[i].load(std::memory_order_relaxed);
+        if (calls > 0 && seen >= fraction * calls)
+        {
+            return uint64_t(1) << (i + 1);
+        }
+    }
+    return 0;
+}
+
+std::string Profiler::toString() const
+{
+    std::ostringstream out;
+    out << std::left << std::setw(8) << "section"
+        << std::right << std::setw(10) << "calls"
+        << std::setw(12) << "items"
+        << std::setw(14) << "total us"
+        << std::setw(12) << "mean us"
+        << std::setw(12) << "p50 us<"
+        << std::setw(12) << "p99 us<"
+        << std::setw(12) << "max us" << "\n";
+    out << std::fixed << std::setprecision(1);
+    for (int i = 0; i < static_cast<int>(ProfileSection::count); ++i)
+    {
+        const SectionStats& s = sections[i];
+        uint64_t calls = s.calls.load(std::memory_order_relaxed);
+        double total = s.totalNanos.load(std::memory_order_relaxed) / 1000.0;
+        out << std::left << std::setw(8) << sectionName(static_cast<ProfileSection>(i))
+            << std::right << std::setw(10) << calls
+            << std::setw(12) << s.items.load(std::memory_order_relaxed)
+            << std::setw(14) << total
+            << std::setw(12) << (calls > 0 ? total / calls : 0)
+            << std::setw(12) << percentile(s, 0.5) / 1000.0
+            << std::setw(12) << percentile(s, 0.99) / 1000.0
+            << std::setw(12) << s.maxNanos.load(std::memory_order_relaxed) / 1000.0 << "\n";
+    }
+    return out.str();
+}
+
+std::string Profiler::toJson(const std::string& extraMembers) const
+{
+    std::ostringstream out;
+    out << "{";
+    for (int i = 0; i < static_cast<int>(ProfileSection::count); ++i)
+    {
+        const SectionStats& s = sections[i];
+        if (i > 0)
+            out << ",";
+        out << "\"" << sectionName(static_cast<ProfileSection>(i)) << "\":{"
+            << "\"calls\":" << s.calls.load(std::memory_order_relaxed)
+            << ",\"items\":" << s.items.load(std::memory_order_relaxed)
+            << ",\"totalNanos\":" << s.totalNanos.load(std::memory_order_relaxed)
+            << ",\"maxNanos\":" << s.maxNanos.load(std::memory_order_relaxed)
+            << ",\"log2NanosHistogram\":[";
+        for (int b = 0; b < bucketCount; ++b)
+        {
+            if (b > 0)
+                out << ",";
+            out << s.buckets[b].load(std::memory_order_relaxed);
+        }
+        out << "]}";
+    }
+    if (!extraMembers.empty())
+        out << "," << extraMembers;
+    out << "}";
+    return out.str();
+}
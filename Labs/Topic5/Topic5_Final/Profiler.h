@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/** Build with -DMERKEL_PROFILE=0 to compile every PROFILE_ macro away. */
+#ifndef MERKEL_PROFILE
+#define MERKEL_PROFILE 1
+#endif
+
+/** the parts of a timeframe step we time */
+enum class ProfileSection
+{
+    parse,
+    index,
+    match,
+    /** market, IOC and FOK orders, as they are entered */
+    execute,
+    settle,
+    /** valuing the wallet at the new timeframe's prices */
+    mark,
+    print,
+    count // number of sections, not a section
+};
+
+/** Collects call counts, item counts and a latency histogram for each
+ * ProfileSection. Recording is a handful of relaxed atomic adds, so it is
+ * safe and cheap from any thread.
+ */
+class Profiler
+{
+    public:
+    /** the one profiler everything records into */
+        static Profiler& instance();
+
+        void record(ProfileSection section, uint64_t nanos);
+    /** count work done in a section, e.g. rows parsed or fills settled */
+        void addItems(ProfileSection section, uint64_t items);
+        void reset();
+
+    /** table of calls, items, total/mean/max time and p50/p99 per section */
+        std::string toString() const;
+    /** the same as JSON. extraMembers, e.g. "\"arena\":{...}", are added
+     * to the top-level object after the sections */
+        std::string toJson(const std::string& extraMembers = "") const;
+
+        static const char* sectionName(ProfileSection section);
+
+    private:
+        Profiler();
+
+        /** bucket i holds calls that took [2^i, 2^(i+1)) ns */
+        static const int bucketCount = 40;
+
+        struct SectionStats
+        {
+            std::atomic<uint64_t> calls{0};
+            std::atomic<uint64_t> items{0};
+            std::atomic<uint64_t> totalNanos{0};
+            std::atomic<uint64_t> maxNanos{0};
+            std::atomic<uint64_t> buckets[bucketCount];
+        };
+
+    /** upper bound in ns of the bucket the given fraction of calls fall under */
+        uint64_t percentile(const SectionStats& stats, double fraction) const;
+
+        SectionStats sections[static_cast<int>(ProfileSection::count)];
+};
+
+/** times the enclosing scope into a section */
+class ScopedTimer
+{
+    public:
+        ScopedTimer(ProfileSection _section)
+        : section(_section),
+          start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            Profiler::instance().record(section,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+    private:
+        ProfileSection section;
+        std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if MERKEL_PROFILE
+#define PROFILE_SCOPE(section) ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__){ProfileSection::section}
+#define PROFILE_ITEMS(section, n) Profiler::instance().addItems(ProfileSection::section, (n))
+#else
+#define PROFILE_SCOPE(section) ((void)0)
+#define PROFILE_ITEMS(section, n) ((void)0)
+#endif
@@ -0,0 +1,80 @@
+#include "ShardRing.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indexes must be lock-free to share between processes");
+
+// spins before each yield while waiting on the other side
+static const unsigned int spinsBeforeYield = 64;
+
+static void copyString(char* to, size_t size, const std::string& from)
+{
+    size_t length = std::min(size - 1, from.size());
+    std::memcpy(to, from.data(), length);
+    to[length] = 0;
+}
+
+ShardMessage ShardMessage::fromEntry(ShardMessageType type, uint32_t frame, const OrderBookEntry& entry)
+{
+    ShardMessage message;
+    message.type = type;
+    message.orderType = entry.orderType;
+    message.frame = frame;
+    message.orderId = entry.orderId;
+    message.price = entry.price;
+    message.amount = entry.amount;
+    copyString(message.timestamp, sizeof(message.timestamp), entry.timestamp);
+    copyString(message.product, sizeof(message.product), entry.product);
+    copyString(message.username, sizeof(message.username), entry.username);
+    return message;
+}
+
+OrderBookEntry ShardMessage::toEntry() const
+{
+    OrderBookEntry entry{price, amount, timestamp, product, orderType, username};
+    entry.orderId = orderId;
+    return entry;
+}
+
+void ShardRing::pause(unsigned int& spins)
+{
+    if (++spins % spinsBeforeYield == 0)
+        std::this_thread::yield();
+}
+
+void ShardRing::push(const ShardMessage& message)
+{
+    unsigned int spins = 0;
+    while (!tryPush(message))
+        pause(spins);
+}
+
+bool ShardRing::tryPush(const ShardMessage& message)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - cachedTail == capacity)
+    {
+        cachedTail = tail.load(std::memory_order_acquire);
+        if (h - cachedTail == capacity)
+            return false;
+    }
+    slots[h % capacity] = message;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+ShardMessage ShardRing::pop()
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    unsigned int spins = 0;
+    while (t == cachedHead)
+    {
+        cachedHead = head.load(std::memory_order_acquire);
+        if (t == cachedHead)
+            pause(spins);
+    }
+    ShardMessage message = slots[t % capacity];
+    tail.store(t + 1, std::memory_order_release);
+    return message;
+}
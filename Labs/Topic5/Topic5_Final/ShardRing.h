@@ -0,0 +1,71 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <atomic>
+#include <cstdint>
+
+/** The kinds of message passed between ShardedExchange processes */
+enum class ShardMessageType : char
+{
+    /** front -> shard: an order for one of the shard's products */
+    order,
+    /** front -> shard: match everything received for this timeframe */
+    match,
+    /** shard -> settlement: one sale, in the shard's matching order */
+    sale,
+    /** shard -> settlement: no more sales for this timeframe */
+    frameEnd,
+    /** no more messages at all */
+    stop
+};
+
+/** one fixed-size message. strings are cut to fit and always end in 0 */
+struct ShardMessage
+{
+    ShardMessageType type;
+    OrderBookType orderType;
+    /** index of the timeframe, in time order */
+    uint32_t frame;
+    unsigned long orderId;
+    double price;
+    double amount;
+    char timestamp[32];
+    char product[24];
+    char username[16];
+
+    static ShardMessage fromEntry(ShardMessageType type, uint32_t frame, const OrderBookEntry& entry);
+    OrderBookEntry toEntry() const;
+};
+
+/** A single-producer single-consumer ring of ShardMessages, laid out to
+ * live in memory shared between two processes. It holds no pointers and
+ * its indexes are lock-free atomics, so placement new it into a shared
+ * mapping before forking.
+ *
+ * The writer and reader each keep their own index and a cached copy of
+ * the other's on separate cache lines, and only reload the other's index
+ * when the ring looks full or empty. Both sides spin briefly and then
+ * yield while they wait, so the ring also works with fewer cores than
+ * processes.
+ */
+class ShardRing
+{
+    public:
+        static const uint64_t capacity = 4096;
+
+    /** waits while the ring is full */
+        void push(const ShardMessage& message);
+    /** returns false instead of waiting if the ring is full */
+        bool tryPush(const ShardMessage& message);
+    /** waits while the ring is empty */
+        ShardMessage pop();
+
+    private:
+        static void pause(unsigned int& spins);
+
+        alignas(64) std::atomic<uint64_t> head{0};
+        uint64_t cachedTail = 0;
+        alignas(64) std::atomic<uint64_t> tail{0};
+        uint64_t cachedHead = 0;
+        alignas(64) ShardMessage slots[capacity];
+};
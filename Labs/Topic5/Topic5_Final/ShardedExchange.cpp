@@ -0,0 +1,341 @@
+#include "ShardedExchange.h"
+#include "ThreadPlacement.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct ShardedExchange::Region
+{
+    static const unsigned int maxShards = 16;
+    static const unsigned int maxCurrencies = 64;
+
+    struct Balance
+    {
+        char currency[16];
+        double amount;
+    };
+
+    ShardRing toShard[maxShards];
+    ShardRing toSettlement[maxShards];
+    // written by settlement before it exits
+    unsigned long sales = 0;
+    unsigned long walletSales = 0;
+    char wallet[8192];
+    Balance balances[maxCurrencies];
+    unsigned int balanceCount = 0;
+};
+
+// failed pushes between checks on the children while a ring is full
+static const unsigned int pushesBeforeCheck = 64;
+
+/** reap the children that have exited and drop them from children.
+ * returns false if any of them failed */
+static bool reapExited(std::vector<pid_t>& children)
+{
+    bool ok = true;
+    for (auto it = children.begin(); it != children.end();)
+    {
+        int status = 0;
+        pid_t pid = waitpid(*it, &status, WNOHANG);
+        if (pid == 0)
+        {
+            ++it;
+            continue;
+        }
+        if (pid != *it || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+        it = children.erase(it);
+    }
+    return ok;
+}
+
+static void killChildren(const std::vector<pid_t>& children)
+{
+    for (pid_t pid : children)
+        kill(pid, SIGKILL);
+}
+
+/** push to a ring the front writes, giving up if a child exits meanwhile,
+ * since no child exits before it is sent stop */
+static bool sendToShard(ShardRing& ring, const ShardMessage& message, std::vector<pid_t>& children)
+{
+    size_t running = children.size();
+    unsigned int pushes = 0;
+    while (!ring.tryPush(message))
+    {
+        if (++pushes % pushesBeforeCheck == 0 && (!reapExited(children) || children.size() < running))
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+ShardedExchange::ShardedExchange(const OrderBook& _orderBook, unsigned int _shards)
+: orderBook(_orderBook)
+{
+    const std::vector<std::string>& products = orderBook.getKnownProducts();
+    if (_shards == 0 || products.empty())
+        throw std::exception{};
+    // more shards than products would just sit idle
+    shards = std::min<unsigned int>({_shards, Region::maxShards, static_cast<unsigned int>(products.size())});
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        shardOfProduct[products[i]] = i % shards;
+    }
+}
+
+const std::map<std::string, unsigned int>& ShardedExchange::getShardOfProduct() const
+{
+    return shardOfProduct;
+}
+
+ShardedResult ShardedExchange::run(const Wallet& wallet)
+{
+    ShardedResult result;
+    result.shards = shards;
+
+    void* memory = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        std::cout << "ShardedExchange::run could not map shared memory: " << std::strerror(errno) << std::endl;
+        return result;
+    }
+    Region* region = new (memory) Region;
+
+    // children inherit anything still buffered and would print it again
+    std::cout.flush();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (unsigned int shard = 0; shard <= shards; ++shard)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::cout << "ShardedExchange::run fork failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (pid == 0)
+        {
+            // the last child settles; the front keeps core 0
+            bool ok = true;
+            if (shard == shards)
+                ok = runSettlement(*region, wallet);
+            else
+                runShard(*region, shard);
+            std::cout.flush();
+            _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+
+    bool forked = children.size() == shards + 1;
+    if (forked)
+    {
+        result.ok = runFront(*region, result, children);
+        if (!result.ok)
+            std::cout << "ShardedExchange::run a child process died" << std::endl;
+    }
+    else
+    {
+        // the shards that did start wait for orders that will never come;
+        // stop them so they can be reaped. settlement forks last, so it
+        // never started if we got here
+        ShardMessage stop{};
+        stop.type = ShardMessageType::stop;
+        for (unsigned int shard = 0; shard < children.size(); ++shard)
+            region->toShard[shard].push(stop);
+    }
+    // the others would wait for ever on one that has died
+    if (forked && !result.ok)
+        killChildren(children);
+    while (!children.empty())
+    {
+        if (!reapExited(children))
+        {
+            result.ok = false;
+            killChildren(children);
+        }
+        if (!children.empty())
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (result.ok)
+    {
+        result.sales = region->sales;
+        result.walletSales = region->walletSales;
+        result.wallet = region->wallet;
+        for (unsigned int i = 0; i < region->balanceCount; ++i)
+            result.balances[region->balances[i].currency] = region->balances[i].amount;
+    }
+    region->~Region();
+    munmap(memory, sizeof(Region));
+    return result;
+}
+
+bool ShardedExchange::runFront(Region& region, ShardedResult& result, std::vector<pid_t>& children)
+{
+    std::vector<OrderSpan> frames = orderBook.getTimeframes();
+    for (uint32_t frame = 0; frame < frames.size(); ++frame)
+    {
+        for (const OrderBookEntry &order : frames[frame])
+        {
+            if (order.orderType != OrderBookType::ask && order.orderType != OrderBookType::bid)
+                continue;
+            if (!sendToShard(region.toShard[shardOfProduct.at(order.product)],
+                             ShardMessage::fromEntry(ShardMessageType::order, frame, order), children))
+                return false;
+            ++result.orders;
+        }
+        ShardMessage match = ShardMessage::fromEntry(ShardMessageType::match, frame, frames[frame][0]);
+        for (unsigned int shard = 0; shard < shards; ++shard)
+        {
+            if (!sendToShard(region.toShard[shard], match, children))
+                return false;
+        }
+    }
+    ShardMessage stop{};
+    stop.type = ShardMessageType::stop;
+    for (unsigned int shard = 0; shard < shards; ++shard)
+    {
+        if (!sendToShard(region.toShard[shard], stop, children))
+            return false;
+    }
+    result.timeframes = frames.size();
+    return true;
+}
+
+void ShardedExchange::runShard(Region& region, unsigned int shard)
+{
+    // shards are matchers; without a placement for them, keep them off
+    // the front's core
+    if (ThreadPlacement::instance().pin(ThreadRole::matcher, shard).empty())
+        pinToCore(shard + 1);
+    ShardRing& in = region.toShard[shard];
+    ShardRing& out = region.toSettlement[shard];
+
+    // this timeframe's asks and bids per product, in arrival order, which
+    // is the order matchAsksToBids sees them in
+    std::map<std::string, std::pair<std::vector<OrderBookEntry>, std::vector<OrderBookEntry>>> orders;
+    std::vector<OrderBookEntry> sales;
+    while (true)
+    {
+        ShardMessage message = in.pop();
+        if (message.type == ShardMessageType::order)
+        {
+            auto &sides = orders[message.product];
+            if (message.orderType == OrderBookType::ask)
+                sides.first.push_back(message.toEntry());
+            else
+                sides.second.push_back(message.toEntry());
+            continue;
+        }
+        if (message.type == ShardMessageType::stop)
+        {
+            out.push(message);
+            return;
+        }
+
+        for (auto &pair : orders)
+        {
+            std::vector<OrderBookEntry> &asks = pair.second.first;
+            std::vector<OrderBookEntry> &bids = pair.second.second;
+            std::sort(asks.begin(), asks.end(), OrderBookEntry::compareByPriceAsc);
+            std::sort(bids.begin(), bids.end(), OrderBookEntry::compareByPriceDesc);
+            sales.clear();
+            OrderBook::matchSortedOrders(asks, bids, pair.first, message.timestamp, sales);
+            for (const OrderBookEntry &sale : sales)
+                out.push(ShardMessage::fromEntry(ShardMessageType::sale, message.frame, sale));
+        }
+        orders.clear();
+        message.type = ShardMessageType::frameEnd;
+        out.push(message);
+    }
+}
+
+bool ShardedExchange::runSettlement(Region& region, Wallet wallet)
+{
+    // past the shards' cores, but never on one an isolated role has claimed
+    std::vector<int> shared = ThreadPlacement::instance().getSharedCores();
+    if (!shared.empty())
+        pinToCore(shared[(shards + 1) % shared.size()]);
+    std::vector<OrderBookEntry> sales;
+    unsigned int stopped = 0;
+    while (stopped < shards)
+    {
+        std::string timestamp;
+        sales.clear();
+        for (unsigned int shard = 0; shard < shards; ++shard)
+        {
+            while (true)
+            {
+                ShardMessage message = region.toSettlement[shard].pop();
+                if (message.type == ShardMessageType::sale)
+                {
+                    sales.push_back(message.toEntry());
+                    continue;
+                }
+                if (message.type == ShardMessageType::stop)
+                    ++stopped;
+                else
+                    timestamp = message.timestamp;
+                break;
+            }
+        }
+        if (stopped > 0)
+            continue;
+
+        // each shard sends its products in order; put them back in the
+        // order a single book would have matched them
+        std::stable_sort(sales.begin(), sales.end(), [](const OrderBookEntry &a, const OrderBookEntry &b)
+                         { return a.product < b.product; });
+        for (const OrderBookEntry &sale : sales)
+        {
+            ++region.sales;
+            if (sale.username == "simuser")
+            {
+                wallet.processSale(sale);
+                ++region.walletSales;
+            }
+        }
+        wallet.releaseTimeframe(timestamp);
+    }
+
+    std::string settled = wallet.toString();
+    size_t length = std::min(settled.size(), sizeof(region.wallet) - 1);
+    std::memcpy(region.wallet, settled.data(), length);
+    region.wallet[length] = 0;
+
+    // the balances go back as they are, to be compared exactly
+    std::map<std::string, double> currencies = wallet.getCurrencies();
+    if (currencies.size() > Region::maxCurrencies)
+        return false;
+    for (const auto &pair : currencies)
+    {
+        Region::Balance &balance = region.balances[region.balanceCount++];
+        if (pair.first.size() >= sizeof(balance.currency))
+            return false;
+        std::memcpy(balance.currency, pair.first.c_str(), pair.first.size() + 1);
+        balance.amount = pair.second;
+    }
+    return true;
+}
+
+void ShardedExchange::pinToCore(unsigned int core)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores <= 1)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % cores, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "ShardRing.h"
+#include "Wallet.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/** what a sharded run did */
+struct ShardedResult
+{
+    unsigned int shards = 0;
+    size_t timeframes = 0;
+    unsigned long orders = 0;
+    unsigned long sales = 0;
+    /** sales that involved simuser and so changed the wallet */
+    unsigned long walletSales = 0;
+    double seconds = 0;
+    /** the settled wallet's toString, from the settlement process */
+    std::string wallet;
+    /** the settled wallet's balances, exactly as settlement left them */
+    std::map<std::string, double> balances;
+    /** false if a child process failed */
+    bool ok = false;
+};
+
+/** Runs matching in one process per shard of the products, instead of
+ * one OrderBook doing every product in turn.
+ *
+ * run() forks the shards and a settlement process. The calling process
+ * is the front: it streams every order in the book, timeframe by
+ * timeframe, to the shard that owns its product, then tells every shard
+ * to match that timeframe. Each shard matches its products with
+ * OrderBook::matchSortedOrders, exactly as matchAsksToBids does, and
+ * streams the sales on to settlement. Settlement takes each timeframe's
+ * sales from every shard, puts them back in product order, settles the
+ * simuser ones into its wallet and releases the timeframe, so the wallet
+ * ends up exactly as a single-process replay would leave it.
+ *
+ * Processes talk over ShardRings in one shared anonymous mapping made
+ * before forking; each shard is pinned to its own core where there are
+ * enough, taken from the matcher cores if ThreadPlacement has any.
+ * Settlement keeps to the cores no isolated role has claimed. simuser's
+ * orders should already be reserved in the wallet.
+ *
+ * If a child dies, the front notices while it waits on a full ring or
+ * for the children to finish, kills the rest and the run fails.
+ */
+class ShardedExchange
+{
+    public:
+        ShardedExchange(const OrderBook& orderBook, unsigned int shards);
+
+    /** which shard matches each product */
+        const std::map<std::string, unsigned int>& getShardOfProduct() const;
+
+        ShardedResult run(const Wallet& wallet);
+
+    private:
+        /** everything the processes share */
+        struct Region;
+
+        /** returns false if a child died before it was sent everything */
+        bool runFront(Region& region, ShardedResult& result, std::vector<pid_t>& children);
+        void runShard(Region& region, unsigned int shard);
+        /** returns false if the wallet's balances do not fit in the region */
+        bool runSettlement(Region& region, Wallet wallet);
+        static void pinToCore(unsigned int core);
+
+        const OrderBook& orderBook;
+        unsigned int shards;
+        std::map<std::string, unsigned int> shardOfProduct;
+};
@@ -0,0 +1,230 @@
+#include "SharedTopOfBook.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<double>::is_always_lock_free, "quotes must be lock-free to share between processes");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "sequences must be lock-free to share between processes");
+
+// tries at a consistent copy of a slot before read() gives up, e.g. on a
+// writer that died part way through an update
+static const unsigned int maxReadAttempts = 10000;
+
+TopOfBookPublisher::TopOfBookPublisher(std::string _name)
+: name(_name)
+{
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+    if (ftruncate(fd, sizeof(TopOfBookRegion)) == 0)
+    {
+        void* memory = mmap(nullptr, sizeof(TopOfBookRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory != MAP_FAILED)
+        {
+            // a fresh shm object is zero filled, which is every slot empty
+            region = static_cast<TopOfBookRegion*>(memory);
+            region->slotSize = sizeof(TopOfBookSlot);
+            region->productCount.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            region->magic = TopOfBookRegion::expectedMagic;
+        }
+    }
+    close(fd);
+}
+
+TopOfBookPublisher::~TopOfBookPublisher()
+{
+    if (region != nullptr)
+    {
+        munmap(region, sizeof(TopOfBookRegion));
+        shm_unlink(name.c_str());
+    }
+}
+
+bool TopOfBookPublisher::isOpen() const
+{
+    return region != nullptr;
+}
+
+uint64_t TopOfBookPublisher::nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TopOfBookSlot* TopOfBookPublisher::slotFor(const std::string& product)
+{
+    if (region == nullptr)
+    {
+        return nullptr;
+    }
+    auto it = slotIndex.find(product);
+    if (it != slotIndex.end())
+    {
+        return &region->slots[it->second];
+    }
+    uint32_t index = region->productCount.load(std::memory_order_relaxed);
+    if (index >= TopOfBookRegion::maxProducts)
+    {
+        return nullptr;
+    }
+    TopOfBookSlot& slot = region->slots[index];
+    strncpy(slot.product, product.c_str(), sizeof(slot.product) - 1);
+    // readers only look at the slot once the count says it is there
+    region->productCount.store(index + 1, std::memory_order_release);
+    slotIndex[product] = index;
+    return &slot;
+}
+
+void TopOfBookPublisher::beginUpdate(TopOfBookSlot& slot)
+{
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TopOfBookPublisher::endUpdate(TopOfBookSlot& slot)
+{
+    slot.publishNanos.store(nowNanos(), std::memory_order_relaxed);
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void TopOfBookPublisher::publishQuote(const std::string& product, double bestBid, double bestAsk)
+{
+    TopOfBookSlot* slot = slotFor(product);
+    if (slot == nullptr)
+    {
+        return;
+    }
+    beginUpdate(*slot);
+    slot->bestBid.store(bestBid, std::memory_order_relaxed);
+    slot->bestAsk.store(bestAsk, std::memory_order_relaxed);
+    endUpdate(*slot);
+}
+
+void TopOfBookPublisher::publishTrade(const std::string& product, double price, double amount)
+{
+    TopOfBookSlot* slot = slotFor(product);
+    if (slot == nullptr)
+    {
+        return;
+    }
+    beginUpdate(*slot);
+    slot->lastPrice.store(price, std::memory_order_relaxed);
+    slot->lastAmount.store(amount, std::memory_order_relaxed);
+    endUpdate(*slot);
+}
+
+TopOfBookReader::TopOfBookReader(std::string name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return;
+    }
+    // the publisher may not have sized it yet, and touching a mapping
+    // past the end of the object is a SIGBUS
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < off_t(sizeof(TopOfBookRegion)))
+    {
+        close(fd);
+        return;
+    }
+    void* memory = mmap(nullptr, sizeof(TopOfBookRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return;
+    }
+    region = static_cast<const TopOfBookRegion*>(memory);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (region->magic != TopOfBookRegion::expectedMagic || region->slotSize != sizeof(TopOfBookSlot))
+    {
+        // not ours, or built with a different layout
+        munmap(const_cast<TopOfBookRegion*>(region), sizeof(TopOfBookRegion));
+        region = nullptr;
+    }
+}
+
+TopOfBookReader::~TopOfBookReader()
+{
+    if (region != nullptr)
+    {
+        munmap(const_cast<TopOfBookRegion*>(region), sizeof(TopOfBookRegion));
+    }
+}
+
+bool TopOfBookReader::isOpen() const
+{
+    return region != nullptr;
+}
+
+std::vector<std::string> TopOfBookReader::getProducts() const
+{
+    std::vector<std::string> products;
+    if (region == nullptr)
+    {
+        return products;
+    }
+    uint32_t count = region->productCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const char* name = region->slots[i].product;
+        products.push_back(std::string{name, strnlen(name, sizeof(region->slots[i].product))});
+    }
+    return products;
+}
+
+int TopOfBookReader::findProduct(const std::string& product) const
+{
+    std::vector<std::string> products = getProducts();
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        if (products[i] == product)
+            return i;
+    }
+    return -1;
+}
+
+bool TopOfBookReader::read(int index, TopOfBookQuote& quote) const
+{
+    if (region == nullptr || index < 0 ||
+        uint32_t(index) >= region->productCount.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    const TopOfBookSlot& slot = region->slots[index];
+    for (unsigned int attempt = 0; attempt < maxReadAttempts; ++attempt)
+    {
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        quote.bestBid = slot.bestBid.load(std::memory_order_relaxed);
+        quote.bestAsk = slot.bestAsk.load(std::memory_order_relaxed);
+        quote.lastPrice = slot.lastPrice.load(std::memory_order_relaxed);
+        quote.lastAmount = slot.lastAmount.load(std::memory_order_relaxed);
+        quote.publishNanos = slot.publishNanos.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before)
+        {
+            quote.version = before / 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t TopOfBookReader::getVersion(int index) const
+{
+    if (region == nullptr || index < 0 || uint32_t(index) >= TopOfBookRegion::maxProducts)
+    {
+        return 0;
+    }
+    return region->slots[index].sequence.load(std::memory_order_acquire) / 2;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Live best bid/ask and last trade per product in a POSIX shared memory
+ * region, for other processes on the same machine.
+ *
+ * The region has a fixed layout: a header and then one slot per product,
+ * each on its own cache lines. There is one writer, TopOfBookPublisher,
+ * and each slot is guarded by a seqlock. The writer makes the slot's
+ * sequence odd, writes the fields and makes it even again. A
+ * TopOfBookReader copies the fields between two reads of the sequence and
+ * tries again if they differ or were odd. Readers never write to the
+ * region, so any number of them can poll without slowing the writer, and
+ * a reader only ever waits out a single slot update in progress.
+ */
+
+/** layout of one product's slot. every field is a lock-free atomic, so
+ * readers racing the writer are well defined and just retry */
+struct alignas(64) TopOfBookSlot
+{
+    /** odd while the writer is part way through an update */
+    std::atomic<uint64_t> sequence;
+    /** written once, before the slot is counted in the header */
+    char product[24];
+    std::atomic<double> bestBid;
+    std::atomic<double> bestAsk;
+    std::atomic<double> lastPrice;
+    std::atomic<double> lastAmount;
+    /** steady_clock time of the update in ns, for measuring latency */
+    std::atomic<uint64_t> publishNanos;
+};
+
+struct TopOfBookRegion
+{
+    static const uint32_t expectedMagic = 0x5458524d; // "MRXT"
+    static const uint32_t maxProducts = 64;
+
+    uint32_t magic;
+    uint32_t slotSize;
+    /** slots [0, productCount) are in use */
+    std::atomic<uint32_t> productCount;
+    TopOfBookSlot slots[maxProducts];
+};
+
+/** what a reader gets back for one product. 0 where there is no price */
+struct TopOfBookQuote
+{
+    double bestBid = 0;
+    double bestAsk = 0;
+    double lastPrice = 0;
+    double lastAmount = 0;
+    uint64_t publishNanos = 0;
+    /** how many times the slot has been updated */
+    uint64_t version = 0;
+};
+
+/** creates the region and is its only writer. the region is removed
+ * again when the publisher is destroyed */
+class TopOfBookPublisher
+{
+    public:
+    /** name as for shm_open, e.g. "/merkelrex-top" */
+        TopOfBookPublisher(std::string name);
+        ~TopOfBookPublisher();
+        TopOfBookPublisher(const TopOfBookPublisher&) = delete;
+        TopOfBookPublisher& operator=(const TopOfBookPublisher&) = delete;
+
+        bool isOpen() const;
+    /** set the best bid and ask, 0 for an empty side */
+        void publishQuote(const std::string& product, double bestBid, double bestAsk);
+        void publishTrade(const std::string& product, double price, double amount);
+
+    /** the clock publishNanos is on. steady_clock is shared by every
+     * process on the machine, so readers can compare against it */
+        static uint64_t nowNanos();
+
+    private:
+    /** the slot for product, adding one if it is new. nullptr when full */
+        TopOfBookSlot* slotFor(const std::string& product);
+        void beginUpdate(TopOfBookSlot& slot);
+        void endUpdate(TopOfBookSlot& slot);
+
+        std::string name;
+        TopOfBookRegion* region = nullptr;
+        std::map<std::string, int> slotIndex;
+};
+
+/** maps a publisher's region read only and takes consistent copies of it */
+class TopOfBookReader
+{
+    public:
+        TopOfBookReader(std::string name);
+        ~TopOfBookReader();
+        TopOfBookReader(const TopOfBookReader&) = delete;
+        TopOfBookReader& operator=(const TopOfBookReader&) = delete;
+
+        bool isOpen() const;
+    /** products in slot order, so the index of each is its slot */
+        std::vector<std::string> getProducts() const;
+    /** slot index of product, or -1 if it has not been published */
+        int findProduct(const std::string& product) const;
+    /** a consistent copy of one slot. false if there is no such slot, or
+     * if it was mid-update every time it was tried */
+        bool read(int index, TopOfBookQuote& quote) const;
+    /** the slot's update count, to poll cheaply for changes */
+        uint64_t getVersion(int index) const;
+
+    private:
+        const TopOfBookRegion* region = nullptr;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "StaticStrategy.h"
+
+/** The same quoting rule as BandStrategy, written for Backtester::runStatic:
+ * a bid band% below and an ask band% above the mid price.
+ */
+class StaticBandStrategy
+{
+    public:
+        StaticBandStrategy(unsigned int _product, std::string _productName, double _band, double _amount)
+        : product(_product),
+          productName(_productName),
+          band(_band),
+          amount(_amount)
+        {
+        }
+
+        std::string getName() const
+        {
+            return "static band " + productName + " " + std::to_string(band * 100) + "%";
+        }
+
+        void onTimeframe(const TimeframeView& view, const Wallet& /*wallet*/, OrderBuffer& orders)
+        {
+            double bestAsk = view.getBestAsk(product);
+            double bestBid = view.getBestBid(product);
+            if (bestAsk == 0 || bestBid == 0)
+            {
+                return;
+            }
+            double mid = (bestAsk + bestBid) / 2;
+            orders.add(product, OrderBookType::bid, mid * (1 - band), amount);
+            orders.add(product, OrderBookType::ask, mid * (1 + band), amount);
+        }
+
+    private:
+        unsigned int product;
+        std::string productName;
+        double band;
+        double amount;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "MarketTimeline.h"
+#include "Wallet.h"
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Building blocks for strategies run through Backtester::runStatic.
+ * Unlike TradingStrategy there are no virtual calls: the strategy type is
+ * a template parameter, so the compiler can inline onTimeframe straight
+ * into the replay loop. Everything here is header-only for the same reason.
+ */
+
+/** one order a strategy wants to place. products are referred to by
+ * their index in Backtester::getKnownProducts, so no strings are built
+ * unless the order actually reaches the matcher */
+struct OrderIntent
+{
+    unsigned int product;
+    OrderBookType orderType;
+    double price;
+    double amount;
+};
+
+/** fixed-capacity buffer that strategies emit orders into.
+ * all memory is allocated up front; add() just fills the next slot */
+class OrderBuffer
+{
+    public:
+        static const size_t defaultCapacity = 64;
+
+        OrderBuffer(size_t capacity = defaultCapacity)
+        : intents(capacity),
+          count(0),
+          dropped(0)
+        {
+        }
+
+    /** returns false (and drops the order) if the buffer is full */
+        bool add(unsigned int product, OrderBookType orderType, double price, double amount)
+        {
+            if (count == intents.size())
+            {
+                ++dropped;
+                return false;
+            }
+            intents[count++] = OrderIntent{product, orderType, price, amount};
+            return true;
+        }
+
+        size_t size() const { return count; }
+    /** orders add() turned away since the last clear() */
+        size_t getDropped() const { return dropped; }
+        const OrderIntent& operator[](size_t i) const { return intents[i]; }
+        void clear()
+        {
+            count = 0;
+            dropped = 0;
+        }
+
+    private:
+        std::vector<OrderIntent> intents;
+        size_t count;
+        size_t dropped;
+};
+
+/** one timeframe of the book, with products looked up by index */
+class TimeframeView
+{
+    public:
+        TimeframeView(const Timeframe& _frame, const std::vector<const ProductFrame*>& _products)
+        : frame(_frame),
+          products(_products)
+        {
+        }
+
+        const std::string& getTimestamp() const { return frame.timestamp; }
+        size_t getProductCount() const { return products.size(); }
+    /** the orders for this product, or nullptr if it had none this timeframe */
+        const ProductFrame* getProduct(unsigned int product) const { return products[product]; }
+
+    /** lowest ask price, or 0 if there are no asks */
+        double getBestAsk(unsigned int product) const
+        {
+            const ProductFrame* p = products[product];
+            return p == nullptr || p->asks.empty() ? 0 : p->asks[0].price;
+        }
+    /** highest bid price, or 0 if there are no bids */
+        double getBestBid(unsigned int product) const
+        {
+            const ProductFrame* p = products[product];
+            return p == nullptr || p->bids.empty() ? 0 : p->bids[0].price;
+        }
+
+    private:
+        const Timeframe& frame;
+        const std::vector<const ProductFrame*>& products;
+};
+
+/** true if S has the members runStatic needs:
+ *   void onTimeframe(const TimeframeView&, const Wallet&, OrderBuffer&)
+ *   std::string getName() const
+ */
+template <typename S, typename = void>
+struct IsStaticStrategy : std::false_type
+{
+};
+
+template <typename S>
+struct IsStaticStrategy<S, decltype(std::declval<S&>().onTimeframe(std::declval<const TimeframeView&>(),
+                                                                   std::declval<const Wallet&>(),
+                                                                   std::declval<OrderBuffer&>()),
+                                    std::string{std::declval<const S&>().getName()},
+                                    void())>
+    : std::true_type
+{
+};
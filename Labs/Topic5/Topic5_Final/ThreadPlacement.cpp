@@ -0,0 +1,239 @@
+#include "ThreadPlacement.h"
+#include "CSVReader.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/** the calling thread's se.nr_migrations, or -1 if the kernel has no such count */
+static long threadMigrations()
+{
+    std::ifstream sched{"/proc/thread-self/sched"};
+    std::string line;
+    while (std::getline(sched, line))
+    {
+        if (line.compare(0, 16, "se.nr_migrations") != 0)
+            continue;
+        size_t colon = line.find(':');
+        return colon == std::string::npos ? -1 : std::stol(line.substr(colon + 1));
+    }
+    return -1;
+}
+
+/** "0-3" -> 0 1 2 3, "5" -> 5 */
+static void parseCores(const std::string& range, std::vector<int>& cores)
+{
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    if (first < 0 || last < first)
+        throw std::exception{};
+    for (int core = first; core <= last; ++core)
+        cores.push_back(core);
+}
+
+ThreadPlacement& ThreadPlacement::instance()
+{
+    static ThreadPlacement placement;
+    return placement;
+}
+
+ThreadPlacement::ThreadPlacement()
+{
+
+}
+
+void ThreadPlacement::configure(const std::string& spec)
+{
+    // cores are separated by '+' since ',' separates roles: matcher=0-1+4
+    for (const std::string& setting : CSVReader::tokenise(spec, ','))
+    {
+        size_t equals = setting.find('=');
+        if (equals == std::string::npos)
+            throw std::exception{};
+        std::string key = setting.substr(0, equals);
+        std::string value = setting.substr(equals + 1);
+        if (key == "isolate")
+        {
+            setIsolated(stringToThreadRole(value), true);
+            continue;
+        }
+        std::vector<int> roleCores;
+        for (const std::string& range : CSVReader::tokenise(value, '+'))
+            parseCores(range, roleCores);
+        setCores(stringToThreadRole(key), roleCores);
+    }
+}
+
+void ThreadPlacement::setCores(ThreadRole role, std::vector<int> roleCores)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    cores[static_cast<int>(role)] = roleCores;
+    configured = true;
+}
+
+void ThreadPlacement::setIsolated(ThreadRole role, bool isolate)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    isolated[static_cast<int>(role)] = isolate;
+    configured = true;
+}
+
+bool ThreadPlacement::isConfigured() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return configured;
+}
+
+std::vector<int> ThreadPlacement::getCores(ThreadRole role) const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    std::vector<int> allowed = cores[static_cast<int>(role)];
+    std::vector<int> reserved;
+    for (int r = 0; r < static_cast<int>(ThreadRole::count); ++r)
+    {
+        if (isolated[r] && r != static_cast<int>(role))
+            reserved.insert(reserved.end(), cores[r].begin(), cores[r].end());
+    }
+    if (reserved.empty())
+        return allowed;
+
+    // an unset role may use any core that is not reserved
+    if (allowed.empty())
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int core = 0; core < online; ++core)
+            allowed.push_back(core);
+    }
+    allowed.erase(std::remove_if(allowed.begin(), allowed.end(), [&reserved](int core)
+                                 { return std::find(reserved.begin(), reserved.end(), core) != reserved.end(); }),
+                  allowed.end());
+    return allowed;
+}
+
+std::vector<int> ThreadPlacement::getSharedCores() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    std::vector<int> shared;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int core = 0; core < online; ++core)
+    {
+        bool reserved = false;
+        for (int r = 0; r < static_cast<int>(ThreadRole::count); ++r)
+        {
+            if (isolated[r] && std::find(cores[r].begin(), cores[r].end(), core) != cores[r].end())
+                reserved = true;
+        }
+        if (!reserved)
+            shared.push_back(core);
+    }
+    return shared;
+}
+
+std::vector<int> ThreadPlacement::pin(ThreadRole role, int index)
+{
+    std::vector<int> allowed = getCores(role);
+    if (allowed.empty())
+        return allowed;
+    if (index >= 0)
+        allowed = {allowed[index % allowed.size()]};
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : allowed)
+        CPU_SET(core, &set);
+    // pid 0 is the calling thread
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return {};
+    return allowed;
+}
+
+void ThreadPlacement::addStats(const ThreadStats& threadStats)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    stats.push_back(threadStats);
+}
+
+std::vector<ThreadStats> ThreadPlacement::getStats() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return stats;
+}
+
+std::string ThreadPlacement::toString() const
+{
+    std::ostringstream out;
+    out << std::left << std::setw(16) << "thread"
+        << std::setw(10) << "role"
+        << std::setw(14) << "cores"
+        << std::right << std::setw(12) << "voluntary"
+        << std::setw(14) << "involuntary"
+        << std::setw(12) << "migrations"
+        << std::setw(8) << "core" << "\n";
+    for (const ThreadStats& s : getStats())
+    {
+        std::string coreList;
+        for (int core : s.cores)
+            coreList += (coreList.empty() ? "" : "+") + std::to_string(core);
+        out << std::left << std::setw(16) << s.name
+            << std::setw(10) << roleName(s.role)
+            << std::setw(14) << (coreList.empty() ? "any" : coreList)
+            << std::right << std::setw(12) << s.voluntarySwitches
+            << std::setw(14) << s.involuntarySwitches
+            << std::setw(12) << (s.migrations < 0 ? std::string{"?"} : std::to_string(s.migrations))
+            << std::setw(8) << s.lastCore << "\n";
+    }
+    return out.str();
+}
+
+const char* ThreadPlacement::roleName(ThreadRole role)
+{
+    switch (role)
+    {
+        case ThreadRole::parser: return "parser";
+        case ThreadRole::matcher: return "matcher";
+        case ThreadRole::gateway: return "gateway";
+        case ThreadRole::logger: return "logger";
+        default: return "unknown";
+    }
+}
+
+ThreadRole ThreadPlacement::stringToThreadRole(const std::string& s)
+{
+    for (int r = 0; r < static_cast<int>(ThreadRole::count); ++r)
+    {
+        if (s == roleName(static_cast<ThreadRole>(r)))
+            return static_cast<ThreadRole>(r);
+    }
+    throw std::exception{};
+}
+
+PlacedThread::PlacedThread(ThreadRole role, std::string name, int index)
+{
+    stats.name = name;
+    stats.role = role;
+    stats.cores = ThreadPlacement::instance().pin(role, index);
+
+    rusage usage{};
+    getrusage(RUSAGE_THREAD, &usage);
+    // counted as differences, in case the thread did other work before
+    stats.voluntarySwitches = -usage.ru_nvcsw;
+    stats.involuntarySwitches = -usage.ru_nivcsw;
+    startMigrations = threadMigrations();
+}
+
+PlacedThread::~PlacedThread()
+{
+    rusage usage{};
+    getrusage(RUSAGE_THREAD, &usage);
+    stats.voluntarySwitches += usage.ru_nvcsw;
+    stats.involuntarySwitches += usage.ru_nivcsw;
+    long migrations = threadMigrations();
+    if (startMigrations >= 0 && migrations >= 0)
+        stats.migrations = migrations - startMigrations;
+    stats.lastCore = sched_getcpu();
+    ThreadPlacement::instance().addStats(stats);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** the kinds of thread the exchange runs */
+enum class ThreadRole
+{
+    /** CSVReader chunk parsers */
+    parser,
+    /** ParallelReplay workers and ShardedExchange shards */
+    matcher,
+    /** the OrderGateway event loop */
+    gateway,
+    /** the TradeExporter background writer */
+    logger,
+    count // number of roles, not a role
+};
+
+/** how one thread ran, from when it was placed to when it finished */
+struct ThreadStats
+{
+    std::string name;
+    ThreadRole role;
+    /** the cores it was allowed on, empty if it was not pinned */
+    std::vector<int> cores;
+    long voluntarySwitches = 0;
+    long involuntarySwitches = 0;
+    /** times it moved between cores, -1 if the kernel does not say */
+    long migrations = -1;
+    /** the core it finished on */
+    int lastCore = -1;
+};
+
+/** Which cores each ThreadRole may run on, and what each placed thread
+ * went through.
+ *
+ * Roles with no cores set run wherever the scheduler likes. An isolated
+ * role keeps its cores to itself: every other role, set or not, is kept
+ * off them (a role left with no cores at all is not pinned). Only
+ * threads started by the exchange are placed, so for full isolation the
+ * cores should also be kept from other processes, e.g. with isolcpus or
+ * a cpuset.
+ *
+ * A thread places itself by declaring a PlacedThread, which pins it on
+ * construction and records its context switches and migrations into
+ * stats on destruction.
+ */
+class ThreadPlacement
+{
+    public:
+    /** the one placement every thread follows */
+        static ThreadPlacement& instance();
+
+    /** set up from a spec like "matcher=2-3+6,gateway=1,logger=0,isolate=matcher",
+     * i.e. role=cores with ranges joined by '+'. throws on anything it
+     * does not understand */
+        void configure(const std::string& spec);
+        void setCores(ThreadRole role, std::vector<int> cores);
+        void setIsolated(ThreadRole role, bool isolated);
+    /** the cores a thread in this role may use after isolation,
+     * empty to leave it unpinned */
+        std::vector<int> getCores(ThreadRole role) const;
+    /** every online core that no isolated role keeps to itself, for
+     * threads and processes that have no role */
+        std::vector<int> getSharedCores() const;
+        bool isConfigured() const;
+
+    /** pin the calling thread to its role's cores, or to just the
+     * index'th of them (wrapping round) to spread workers one per core.
+     * returns the cores it is now allowed on, empty if left alone */
+        std::vector<int> pin(ThreadRole role, int index = -1);
+
+        void addStats(const ThreadStats& stats);
+        std::vector<ThreadStats> getStats() const;
+    /** table of every finished placed thread */
+        std::string toString() const;
+
+        static const char* roleName(ThreadRole role);
+        static ThreadRole stringToThreadRole(const std::string& s);
+
+    private:
+        ThreadPlacement();
+
+        mutable std::mutex mutex;
+        std::vector<int> cores[static_cast<int>(ThreadRole::count)];
+        bool isolated[static_cast<int>(ThreadRole::count)] = {};
+        bool configured = false;
+        std::vector<ThreadStats> stats;
+};
+
+/** places the calling thread for as long as it is in scope */
+class PlacedThread
+{
+    public:
+        PlacedThread(ThreadRole role, std::string name, int index = -1);
+        ~PlacedThread();
+
+    private:
+        ThreadStats stats;
+        long startMigrations;
+};
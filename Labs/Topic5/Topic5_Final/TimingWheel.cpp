@@ -0,0 +1,180 @@
+#include "TimingWheel.h"
+
+TimingWheel::TimingWheel(uint64_t startMicros, uint64_t _tickMicros)
+: tickMicros(_tickMicros == 0 ? 1 : _tickMicros),
+  currentTick(startMicros / tickMicros),
+  heads(levels * slots, -1)
+{
+
+}
+
+TimerId TimingWheel::schedule(uint64_t dueMicros, int kind, uint64_t data)
+{
+    int32_t index;
+    if (!freeTimers.empty())
+    {
+        index = freeTimers.back();
+        freeTimers.pop_back();
+    }
+    else
+    {
+        index = timers.size();
+        timers.push_back(Timer{});
+    }
+    Timer& timer = timers[index];
+    ++timer.generation;
+    // ids start at 1 because the generation is never 0 here
+    TimerId id = (uint64_t(timer.generation) << 32) | uint32_t(index);
+    // round up, so a timer never fires before it is due
+    timer.dueTick = (dueMicros + tickMicros - 1) / tickMicros;
+    if (timer.dueTick <= currentTick)
+    {
+        timer.dueTick = currentTick + 1;
+    }
+    timer.event = TimerEvent{id, dueMicros, kind, data};
+    timer.active = true;
+    place(index);
+    ++pending;
+    return id;
+}
+
+void TimingWheel::place(int32_t index)
+{
+    Timer& timer = timers[index];
+    uint64_t delta = timer.dueTick - currentTick;
+    int level = 0;
+    while (level < levels - 1 && delta >= (uint64_t(1) << (slotBits * (level + 1))))
+    {
+        ++level;
+    }
+    // beyond the last wheel: park in its furthest slot and re-place on cascade
+    uint64_t tick = timer.dueTick;
+    if (delta >= (uint64_t(1) << (slotBits * levels)))
+    {
+        tick = currentTick + (uint64_t(slots - 1) << (slotBits * (levels - 1)));
+    }
+    int slot = (tick >> (slotBits * level)) & (slots - 1);
+    timer.slot = level * slots + slot;
+    ++levelCounts[level];
+    int32_t& head = heads[timer.slot];
+    timer.prev = -1;
+    timer.next = head;
+    if (head >= 0)
+    {
+        timers[head].prev = index;
+    }
+    head = index;
+}
+
+void TimingWheel::unlink(int32_t index)
+{
+    Timer& timer = timers[index];
+    if (timer.prev >= 0)
+    {
+        timers[timer.prev].next = timer.next;
+    }
+    else
+    {
+        heads[timer.slot] = timer.next;
+    }
+    if (timer.next >= 0)
+    {
+        timers[timer.next].prev = timer.prev;
+    }
+    --levelCounts[timer.slot / slots];
+}
+
+bool TimingWheel::cancel(TimerId id)
+{
+    uint32_t index = uint32_t(id);
+    uint32_t generation = uint32_t(id >> 32);
+    if (index >= timers.size() || !timers[index].active || timers[index].generation != generation)
+    {
+        return false;
+    }
+    unlink(index);
+    timers[index].active = false;
+    freeTimers.push_back(index);
+    --pending;
+    return true;
+}
+
+void TimingWheel::cascade(int level)
+{
+    int slot = (currentTick >> (slotBits * level)) & (slots - 1);
+    int32_t index = heads[level * slots + slot];
+    heads[level * slots + slot] = -1;
+    while (index >= 0)
+    {
+        int32_t next = timers[index].next;
+        --levelCounts[level];
+        place(index);
+        index = next;
+    }
+}
+
+void TimingWheel::advance(uint64_t nowMicros, std::vector<TimerEvent>& expired)
+{
+    uint64_t target = nowMicros / tickMicros;
+    while (currentTick < target)
+    {
+        if (pending == 0)
+        {
+            // nothing to fire on the way, so jump straight there
+            currentTick = target;
+            break;
+        }
+        // with the finer wheels empty, nothing can happen until the next
+        // turn of the first wheel that has timers, so skip to just before it
+        int lowest = 0;
+        while (levelCounts[lowest] == 0)
+        {
+            ++lowest;
+        }
+        if (lowest > 0)
+        {
+            uint64_t turn = uint64_t(1) << (slotBits * lowest);
+            uint64_t skipTo = (currentTick | (turn - 1));
+            if (skipTo >= target)
+            {
+                currentTick = target;
+                break;
+            }
+            currentTick = skipTo;
+        }
+
+        ++currentTick;
+        // entering a new turn of a wheel brings its next slot down a level
+        for (int level = 1; level < levels; ++level)
+        {
+            if ((currentTick & ((uint64_t(1) << (slotBits * level)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+
+        int32_t& head = heads[currentTick & (slots - 1)];
+        int32_t index = head;
+        head = -1;
+        while (index >= 0)
+        {
+            Timer& timer = timers[index];
+            int32_t next = timer.next;
+            expired.push_back(timer.event);
+            --levelCounts[0];
+            timer.active = false;
+            freeTimers.push_back(index);
+            --pending;
+            index = next;
+        }
+    }
+}
+
+uint64_t TimingWheel::getNowMicros() const
+{
+    return currentTick * tickMicros;
+}
+
+size_t TimingWheel::getPendingCount() const
+{
+    return pending;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** handle for a scheduled timer. 0 is never a valid id */
+typedef uint64_t TimerId;
+
+/** a timer that has come due. kind and data are whatever was scheduled,
+ * e.g. an event type and an order id */
+struct TimerEvent
+{
+    TimerId id;
+    uint64_t dueMicros;
+    int kind;
+    uint64_t data;
+};
+
+/** A hierarchical timing wheel on the simulation clock, in microseconds.
+ *
+ * There are four wheels of 256 slots. The first has one slot per tick,
+ * and each one after that has slots 256 times wider than the last. A timer
+ * goes into the coarsest wheel it needs, so scheduling and cancelling are
+ * O(1) however many timers are pending. As the clock passes a slot of a
+ * coarser wheel, its timers are moved down into the finer wheels, so each
+ * timer moves at most three times before it fires. Timers live in one
+ * pooled array, linked through indexes, so nothing is allocated per timer
+ * once the pool has grown. Advancing the clock walks the first wheel a
+ * tick at a time, but skips whole turns of any wheels that are empty.
+ */
+class TimingWheel
+{
+    public:
+    /** startMicros is the clock's starting time. tickMicros is the resolution */
+        TimingWheel(uint64_t startMicros = 0, uint64_t tickMicros = 1000);
+
+    /** run kind/data once the clock reaches dueMicros. a time already
+     * passed fires on the next tick */
+        TimerId schedule(uint64_t dueMicros, int kind, uint64_t data);
+    /** false if the timer has already fired or been cancelled */
+        bool cancel(TimerId id);
+    /** move the clock forward to nowMicros, appending every timer that came
+     * due to expired in due order (by tick). the clock never goes back */
+        void advance(uint64_t nowMicros, std::vector<TimerEvent>& expired);
+
+        uint64_t getNowMicros() const;
+        size_t getPendingCount() const;
+
+    private:
+        static const int levels = 4;
+        static const int slotBits = 8;
+        static const int slots = 1 << slotBits;
+
+        struct Timer
+        {
+            uint64_t dueTick;
+            TimerEvent event;
+            int32_t prev;
+            int32_t next;
+            /** index into heads of the slot it is in */
+            int32_t slot;
+            /** bumped every time the node is reused, so stale ids miss */
+            uint32_t generation;
+            bool active;
+        };
+
+        /** put a timer into the right slot for its due tick */
+        void place(int32_t index);
+        void unlink(int32_t index);
+        /** move every timer in a slot of a coarser wheel down a level */
+        void cascade(int level);
+
+        uint64_t tickMicros;
+        uint64_t currentTick;
+        std::vector<Timer> timers;
+        std::vector<int32_t> freeTimers;
+        /** head of the list in each slot, -1 when empty. levels * slots */
+        std::vector<int32_t> heads;
+        /** timers in each wheel, so empty stretches can be skipped */
+        size_t levelCounts[levels] = {};
+        size_t pending = 0;
+};
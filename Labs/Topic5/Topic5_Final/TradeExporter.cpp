@@ -0,0 +1,258 @@
+#include "TradeExporter.h"
+#include "ThreadPlacement.h"
+#include <charconv>
+#include <cstring>
+
+// buffers in flight at once when writing in the background, including
+// the one being filled
+static const size_t maxChunks = 4;
+// longest shortest-form double is 24 characters
+static const size_t maxNumberSize = 32;
+
+TradeExporter::TradeExporter(FeedSink& _sink, ExportFormat _format, bool _background, size_t _bufferSize)
+: sink(_sink), format(_format), background(_background), bufferSize(_bufferSize)
+{
+    if (bufferSize < 4096)
+        throw std::exception{};
+    current.data.resize(bufferSize);
+    if (background)
+        writer = std::thread{&TradeExporter::writerLoop, this};
+}
+
+TradeExporter::~TradeExporter()
+{
+    flush();
+    if (background)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+    }
+}
+
+ExportFormat TradeExporter::stringToExportFormat(std::string s)
+{
+    if (s == "csv")
+        return ExportFormat::csv;
+    if (s == "ndjson")
+        return ExportFormat::ndjson;
+    throw std::exception{};
+}
+
+void TradeExporter::exportSale(const OrderBookEntry& sale)
+{
+    beginRecord("sale");
+    field("timestamp");
+    putString(sale.timestamp);
+    field("product");
+    putString(sale.product);
+    field("type");
+    putString(sale.orderType == OrderBookType::bidsale ? "bidsale" : "asksale");
+    field("price");
+    putNumber(sale.price);
+    field("amount");
+    putNumber(sale.amount);
+    field("username");
+    putString(sale.username);
+    field("orderId");
+    putNumber(sale.orderId);
+    endRecord();
+}
+
+void TradeExporter::exportWalletChange(const WalletChange& change)
+{
+    beginRecord("wallet");
+    field("timestamp");
+    putString(change.timestamp);
+    field("currency");
+    putString(change.currency);
+    field("change");
+    putNumber(change.change);
+    field("balance");
+    putNumber(change.balance);
+    endRecord();
+}
+
+void TradeExporter::exportStats(const TimeframeStats& stats)
+{
+    beginRecord("stats");
+    field("timestamp");
+    putString(stats.timestamp);
+    field("product");
+    putString(stats.product);
+    field("sales");
+    putNumber(stats.sales);
+    field("volume");
+    putNumber(stats.volume);
+    field("vwap");
+    putNumber(stats.volume > 0 ? stats.turnover / stats.volume : 0);
+    field("low");
+    putNumber(stats.low);
+    field("high");
+    putNumber(stats.high);
+    endRecord();
+}
+
+void TradeExporter::beginRecord(const char* kind)
+{
+    fields = 0;
+    if (format == ExportFormat::csv)
+    {
+        putRaw(kind, std::strlen(kind));
+        ++fields;
+        return;
+    }
+    putRaw("{", 1);
+    field("kind");
+    putString(kind);
+}
+
+void TradeExporter::endRecord()
+{
+    if (format == ExportFormat::csv)
+        putRaw("\n", 1);
+    else
+        putRaw("}\n", 2);
+    ++records;
+}
+
+void TradeExporter::field(const char* name)
+{
+    if (fields++ > 0)
+        putRaw(",", 1);
+    if (format == ExportFormat::ndjson)
+    {
+        putRaw("\"", 1);
+        putRaw(name, std::strlen(name));
+        putRaw("\":", 2);
+    }
+}
+
+void TradeExporter::putString(const std::string& s)
+{
+    if (format == ExportFormat::csv)
+    {
+        putRaw(s.data(), s.size());
+        return;
+    }
+    // worst case every character needs escaping, plus the quotes
+    reserve(s.size() * 2 + 2);
+    char* out = current.data.data() + current.used;
+    *out++ = '"';
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            *out++ = '\\';
+        *out++ = c;
+    }
+    *out++ = '"';
+    size_t size = out - (current.data.data() + current.used);
+    current.used += size;
+    bytes += size;
+}
+
+void TradeExporter::putNumber(double value)
+{
+    reserve(maxNumberSize);
+    char* begin = current.data.data() + current.used;
+    std::to_chars_result result = std::to_chars(begin, begin + maxNumberSize, value);
+    current.used += result.ptr - begin;
+    bytes += result.ptr - begin;
+}
+
+void TradeExporter::putNumber(unsigned long value)
+{
+    reserve(maxNumberSize);
+    char* begin = current.data.data() + current.used;
+    std::to_chars_result result = std::to_chars(begin, begin + maxNumberSize, value);
+    current.used += result.ptr - begin;
+    bytes += result.ptr - begin;
+}
+
+void TradeExporter::putRaw(const char* s, size_t size)
+{
+    reserve(size);
+    std::memcpy(current.data.data() + current.used, s, size);
+    current.used += size;
+    bytes += size;
+}
+
+void TradeExporter::reserve(size_t size)
+{
+    if (current.used + size <= current.data.size())
+        return;
+    handOff();
+    // one enormous string could still not fit in an empty buffer
+    if (size > current.data.size())
+        current.data.resize(size);
+}
+
+void TradeExporter::handOff()
+{
+    if (current.used == 0)
+        return;
+    if (!background)
+    {
+        sink.write(current.data.data(), current.used);
+        current.used = 0;
+        return;
+    }
+    std::unique_lock<std::mutex> lock{mutex};
+    full.push_back(std::move(current));
+    changed.notify_all();
+    if (spare.empty() && chunks < maxChunks)
+    {
+        ++chunks;
+        lock.unlock();
+        current = Chunk{};
+        current.data.resize(bufferSize);
+        return;
+    }
+    changed.wait(lock, [this] { return !spare.empty(); });
+    current = std::move(spare.back());
+    spare.pop_back();
+    current.used = 0;
+}
+
+void TradeExporter::flush()
+{
+    handOff();
+    if (!background)
+        return;
+    std::unique_lock<std::mutex> lock{mutex};
+    changed.wait(lock, [this] { return full.empty() && !writing; });
+}
+
+void TradeExporter::writerLoop()
+{
+    PlacedThread placed{ThreadRole::logger, "exporter"};
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true)
+    {
+        changed.wait(lock, [this] { return !full.empty() || stopping; });
+        if (full.empty())
+            return;
+        Chunk chunk = std::move(full.front());
+        full.pop_front();
+        writing = true;
+        lock.unlock();
+        sink.write(chunk.data.data(), chunk.used);
+        lock.lock();
+        writing = false;
+        spare.push_back(std::move(chunk));
+        changed.notify_all();
+    }
+}
+
+unsigned long long TradeExporter::getBytes() const
+{
+    return bytes;
+}
+
+unsigned long TradeExporter::getRecords() const
+{
+    return records;
+}
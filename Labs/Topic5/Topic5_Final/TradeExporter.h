@@ -0,0 +1,122 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "FeedSink.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ExportFormat
+{
+    csv,
+    ndjson
+};
+
+/** one change to a wallet balance, e.g. either side of a sale */
+struct WalletChange
+{
+    std::string timestamp;
+    std::string currency;
+    double change;
+    /** the balance after the change */
+    double balance;
+};
+
+/** what traded in one product in one timeframe */
+struct TimeframeStats
+{
+    std::string timestamp;
+    std::string product;
+    unsigned long sales = 0;
+    double volume = 0;
+    /** sum of price * amount, so vwap is turnover / volume */
+    double turnover = 0;
+    double low = 0;
+    double high = 0;
+};
+
+/** Writes sales, wallet changes and timeframe statistics out for offline
+ * analysis, as CSV or as newline-delimited JSON.
+ *
+ * Records are formatted straight into large reusable buffers, numbers with
+ * std::to_chars (shortest form that reads back to the same double), and
+ * each full buffer goes to the sink in a single write. With background
+ * set, full buffers are handed to a writer thread and formatting carries
+ * on into a spare one, so the caller only waits if the sink falls behind.
+ *
+ * CSV has no header since the record kinds are mixed; the first column
+ * says which kind a row is:
+ *   sale,timestamp,product,type,price,amount,username,orderId
+ *   wallet,timestamp,currency,change,balance
+ *   stats,timestamp,product,sales,volume,vwap,low,high
+ * NDJSON has one object per line with the same fields, plus "kind".
+ */
+class TradeExporter
+{
+    public:
+        TradeExporter(FeedSink& sink,
+                      ExportFormat format = ExportFormat::csv,
+                      bool background = false,
+                      size_t bufferSize = 1 << 20);
+    /** flushes, and stops the writer thread */
+        ~TradeExporter();
+
+        void exportSale(const OrderBookEntry& sale);
+        void exportWalletChange(const WalletChange& change);
+        void exportStats(const TimeframeStats& stats);
+
+    /** send everything formatted so far to the sink and wait until it is written */
+        void flush();
+
+    /** bytes formatted so far, written or not */
+        unsigned long long getBytes() const;
+        unsigned long getRecords() const;
+
+        static ExportFormat stringToExportFormat(std::string s);
+
+    private:
+        /** a buffer being filled or waiting to be written */
+        struct Chunk
+        {
+            std::vector<char> data;
+            size_t used = 0;
+        };
+
+    /** make sure the current chunk has room for size more bytes */
+        void reserve(size_t size);
+    /** pass the current chunk to the sink, directly or via the writer thread */
+        void handOff();
+        void writerLoop();
+
+        void beginRecord(const char* kind);
+        void endRecord();
+    /** a field separator, then for NDJSON the field name */
+        void field(const char* name);
+        void putString(const std::string& s);
+        void putNumber(double value);
+        void putNumber(unsigned long value);
+        void putRaw(const char* s, size_t size);
+
+        FeedSink& sink;
+        ExportFormat format;
+        bool background;
+        size_t bufferSize;
+        Chunk current;
+    /** fields written so far in this record */
+        int fields = 0;
+        unsigned long long bytes = 0;
+        unsigned long records = 0;
+
+        // the writer thread's side, under mutex
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<Chunk> full;
+        std::vector<Chunk> spare;
+        size_t chunks = 1;
+        bool writing = false;
+        bool stopping = false;
+        std::thread writer;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "MarketTimeline.h"
+#include "Wallet.h"
+#include <string>
+#include <vector>
+
+/** Interface for an automated trader run by the Backtester.
+ * Each instance is only ever called from one thread at a time.
+ */
+class TradingStrategy
+{
+    public:
+        virtual ~TradingStrategy() {}
+    /** a short name for reports, e.g. "band 0.5%" */
+        virtual std::string getName() = 0;
+    /** called once per timeframe with that frame's dataset orders.
+     * push any asks or bids to place into orders; the backtester fills in
+     * the timestamp and username and drops any the wallet cannot cover */
+        virtual void onTimeframe(const Timeframe& frame,
+                                 const Wallet& wallet,
+                                 std::vector<OrderBookEntry>& orders) = 0;
+};
@@ -1,10 +1,79 @@
 #include "Wallet.h"
 #include "CSVReader.h"
+#include <algorithm>
 #include <iostream>
 
-Wallet::Wallet()
+Wallet::Wallet(std::string _quoteCurrency)
+: state(std::make_shared<State>()), quoteCurrency(_quoteCurrency)
 {
 }
+
+Wallet::Wallet(const Wallet& other)
+{
+    // share the balances until one side changes them
+    std::lock_guard<std::mutex> lock{other.mutex};
+    state = other.state;
+    quoteCurrency = other.quoteCurrency;
+}
+
+Wallet& Wallet::operator=(const Wallet& other)
+{
+    if (this != &other)
+    {
+        std::unique_lock<std::mutex> lockThis{mutex, std::defer_lock};
+        std::unique_lock<std::mutex> lockOther{other.mutex, std::defer_lock};
+        std::lock(lockThis, lockOther);
+        state = other.state;
+        quoteCurrency = other.quoteCurrency;
+    }
+    return *this;
+}
+
+void Wallet::unshare()
+{
+    if (state.use_count() > 1)
+    {
+        state = std::make_shared<State>(*state);
+    }
+}
+
+bool Wallet::hasSameBalances(const Wallet& other) const
+{
+    if (this == &other)
+    {
+        return true;
+    }
+    std::unique_lock<std::mutex> lockThis{mutex, std::defer_lock};
+    std::unique_lock<std::mutex> lockOther{other.mutex, std::defer_lock};
+    std::lock(lockThis, lockOther);
+    if (state == other.state)
+    {
+        return true;
+    }
+    if (state->currencies != other.state->currencies ||
+        state->held != other.state->held ||
+        state->reservations.size() != other.state->reservations.size())
+    {
+        return false;
+    }
+    return std::equal(state->reservations.begin(), state->reservations.end(),
+                      other.state->reservations.begin(),
+                      [](const std::pair<const unsigned long, Reservation>& a,
+                         const std::pair<const unsigned long, Reservation>& b)
+                      {
+                          return a.first == b.first &&
+                                 a.second.currency == b.second.currency &&
+                                 a.second.amount == b.second.amount &&
+                                 a.second.timestamp == b.second.timestamp;
+                      });
+}
+
+size_t Wallet::getShareCount() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return state.use_count();
+}
+
 /** insert currency to the wallet */
 void Wallet::insertCurrency(std::string type, double amount)
 {
@@ -14,107 +83,451 @@ void Wallet::insertCurrency(std::string type, double amount)
         // crash the program if user puts negative amount
         throw std::exception{};
     }
-    if (currencies.count(type) == 0)
+    std::lock_guard<std::mutex> lock{mutex};
+    unshare();
+    if (state->currencies.count(type) == 0)
     {
         balance = 0;
     }
     else
     {
-        balance = currencies[type];
+        balance = state->currencies[type];
     }
+    // a deposit costs what it is worth now, if we know that yet
+    double mark = markOf(type);
+    addQuantity(type, amount, mark > 0 ? amount * mark : -1);
     balance += amount;
-    currencies[type] = balance;
+    state->currencies[type] = balance;
 }
 
 /** remove currency to the wallet */
 bool Wallet::removeCurrency(std::string type, double amount)
 {
-    if (amount < 0 || currencies.count(type) == 0 || currencies[type] < amount)
+    std::lock_guard<std::mutex> lock{mutex};
+    if (amount < 0 || state->currencies.count(type) == 0 || available(type) < amount)
     {
         return false;
     }
 
-    currencies[type] -= amount;
+    unshare();
+    removeQuantity(type, amount, -1);
+    state->currencies[type] -= amount;
     return true;
 }
 
 /** check if the wallet contains this much currency or more */
 bool Wallet::containsCurrency(std::string type, double amount)
 {
-    if (currencies.count(type) == 0)
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = state->currencies.find(type);
+    if (it == state->currencies.end())
     {
         return false;
     }
-    return currencies[type] >= amount;
+    return it->second >= amount;
 }
 
-/** check if the wallet can cope with this ask or bid. */
-bool Wallet::canFulfilOrder(OrderBookEntry order)
+bool Wallet::getOrderCost(const OrderBookEntry& order, std::string& currency, double& amount)
 {
     /**
      * Currency1/Currency2, price, amount
      * Currency1 is the currency you own
      * Currency2 is the currency you want
      **/
-    std::vector<std::string> currencies = CSVReader::tokenise(order.product, '/');
+    std::vector<std::string> currs = CSVReader::tokenise(order.product, '/');
+    if (currs.size() != 2)
+    {
+        return false;
+    }
 
     // ask: check if you own enough currency1 to buy currency2
     if (order.orderType == OrderBookType::ask)
     {
-        double amount = order.amount;
-        std::string currency = currencies[0];
-        std::cout << "Wallet::canfulfilOrder: currency = " << currency << ", amount = " << amount << std::endl;
-        return containsCurrency(currency, amount);
+        amount = order.amount;
+        currency = currs[0];
+        return true;
     }
 
     // bid: check if you own enough currency2 to sell currency1
     if (order.orderType == OrderBookType::bid)
     {
-        double amount = order.amount * order.price;
-        std::string currency = currencies[1];
-        return containsCurrency(currency, amount);
+        amount = order.amount * order.price;
+        currency = currs[1];
+        return true;
     }
     return false;
 }
 
+/** check if the wallet can cope with this ask or bid. */
+bool Wallet::canFulfilOrder(const OrderBookEntry& order)
+{
+    std::string currency;
+    double amount;
+    if (!getOrderCost(order, currency, amount))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    return available(currency) >= amount;
+}
+
+bool Wallet::reserveOrder(const OrderBookEntry& order)
+{
+    std::string currency;
+    double amount;
+    if (!getOrderCost(order, currency, amount))
+    {
+        return false;
+    }
+    return reserve(order.orderId, currency, amount, order.timestamp);
+}
+
+bool Wallet::reserve(unsigned long orderId, const std::string& currency, double amount,
+                     const std::string& timestamp)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    if (available(currency) < amount || state->reservations.count(orderId) > 0)
+    {
+        return false;
+    }
+    unshare();
+    state->held[currency] += amount;
+    state->reservations[orderId] = Reservation{currency, amount, timestamp};
+    return true;
+}
+
+void Wallet::releaseOrder(unsigned long orderId)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    if (state->reservations.count(orderId) == 0)
+    {
+        return;
+    }
+    unshare();
+    release(state->reservations.find(orderId));
+}
+
+void Wallet::moveReservation(unsigned long orderId, const std::string& timestamp)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    if (state->reservations.count(orderId) == 0)
+    {
+        return;
+    }
+    unshare();
+    state->reservations[orderId].timestamp = timestamp;
+}
+
+void Wallet::releaseTimeframe(const std::string& timestamp)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    // most timeframes leave nothing held, so only copy if there is work
+    bool any = std::any_of(state->reservations.begin(), state->reservations.end(),
+                           [&timestamp](const std::pair<const unsigned long, Reservation> &r)
+                           { return r.second.timestamp == timestamp; });
+    if (!any)
+    {
+        return;
+    }
+    unshare();
+    for (auto it = state->reservations.begin(); it != state->reservations.end();)
+    {
+        auto current = it++;
+        if (current->second.timestamp == timestamp)
+        {
+            release(current);
+        }
+    }
+}
+
+void Wallet::release(std::map<unsigned long, Reservation>::iterator it)
+{
+    state->held[it->second.currency] -= it->second.amount;
+    state->reservations.erase(it);
+}
+
+double Wallet::available(const std::string& type) const
+{
+    auto balance = state->currencies.find(type);
+    if (balance == state->currencies.end())
+    {
+        return 0;
+    }
+    auto h = state->held.find(type);
+    return balance->second - (h == state->held.end() ? 0 : h->second);
+}
+
+double Wallet::getAvailable(std::string type) const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return available(type);
+}
+
+double Wallet::getHeld(std::string type) const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    auto h = state->held.find(type);
+    return h == state->held.end() ? 0 : h->second;
+}
+
 std::string Wallet::toString()
 {
+    std::lock_guard<std::mutex> lock{mutex};
     std::string s;
-    for (std::pair<std::string, double> pair : currencies)
+    for (std::pair<std::string, double> pair : state->currencies)
     {
         std::string currency = pair.first;
         double amount = pair.second;
-        s += currency + ": " + std::to_string(amount) + "\n";
+        s += currency + ": " + std::to_string(amount);
+        auto h = state->held.find(currency);
+        if (h != state->held.end() && h->second > 0)
+        {
+            s += " (" + std::to_string(h->second) + " held)";
+        }
+        s += "\n";
+    }
+    if (state->marketValue != 0 || state->realisedPnl != 0)
+    {
+        s += "Value: " + std::to_string(state->marketValue) + " " + quoteCurrency +
+             " (unrealised PnL " + std::to_string(state->marketValue - state->markedCostBasis) +
+             ", realised PnL " + std::to_string(state->realisedPnl) + ")";
+        // holdings with no mark are not in the value, so say which
+        std::string unpriced;
+        for (const std::pair<const std::string, double>& pair : state->currencies)
+        {
+            if (pair.second != 0 && markOf(pair.first) == 0)
+            {
+                unpriced += (unpriced.empty() ? "" : ", ") + pair.first;
+            }
+        }
+        if (!unpriced.empty())
+        {
+            s += ", not counting unpriced " + unpriced;
+        }
+        s += "\n";
     }
     return s;
 }
 
-void Wallet::processSale(OrderBookEntry & sale)
+std::map<std::string, double> Wallet::getCurrencies() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return state->currencies;
+}
+
+bool Wallet::processSale(const OrderBookEntry & sale)
 {
     std::vector<std::string> currs = CSVReader::tokenise(sale.product, '/');
+    if (currs.size() != 2)
+    {
+        return false;
+    }
+    return processSale(currs[0], currs[1], sale.orderType, sale.price, sale.amount, sale.orderId);
+}
+
+bool Wallet::processSale(const std::string& base, const std::string& quote,
+                         OrderBookType saleType, double price, double amount,
+                         unsigned long orderId)
+{
+    if (saleType != OrderBookType::asksale && saleType != OrderBookType::bidsale)
+    {
+        return false;
+    }
+    // an ask gives up base for quote, a bid the other way round
+    bool ask = saleType == OrderBookType::asksale;
+    const std::string& outgoingCurrency = ask ? base : quote;
+    const std::string& incomingCurrency = ask ? quote : base;
+    double outgoingAmount = ask ? amount : amount * price;
+    double incomingAmount = ask ? amount * price : amount;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    // spend out of the order's reservation first. a bid can fill below its
+    // price, so it may use less than was held; the rest is released later
+    auto it = state->reservations.find(orderId);
+    double fromHeld = 0;
+    if (it != state->reservations.end() && it->second.currency == outgoingCurrency)
+    {
+        fromHeld = std::min(outgoingAmount, it->second.amount);
+    }
+    // anything beyond the reservation has to be free to spend. the slack
+    // only absorbs rounding in a reservation used up over several fills
+    if (outgoingAmount - fromHeld > available(outgoingCurrency) + outgoingAmount * 1e-12)
+    {
+        return false;
+    }
+    unshare();
+    if (fromHeld > 0)
+    {
+        // unshare may have copied the state, so look the reservation up again
+        Reservation& reservation = state->reservations[orderId];
+        reservation.amount -= fromHeld;
+        state->held[outgoingCurrency] -= fromHeld;
+    }
+
+    // what the trade was worth in the quote currency, at the price it
+    // traded at. a product not quoted in it goes through the mark of its
+    // price currency, or failing that of what is being priced; -1 if
+    // neither has been marked yet
+    double value = -1;
+    if (quote == quoteCurrency)
+    {
+        value = price * amount;
+    }
+    else if (base == quoteCurrency)
+    {
+        value = amount;
+    }
+    else if (markOf(quote) > 0)
+    {
+        value = price * amount * markOf(quote);
+    }
+    else if (markOf(base) > 0)
+    {
+        value = amount * markOf(base);
+    }
+    removeQuantity(outgoingCurrency, outgoingAmount, value);
+    addQuantity(incomingCurrency, incomingAmount, value);
+
+    state->currencies[incomingCurrency] += incomingAmount;
+    state->currencies[outgoingCurrency] -= outgoingAmount;
+    return true;
+}
 
-    if (sale.orderType == OrderBookType::asksale)
+void Wallet::updateMark(const std::string& product, double bestBid, double bestAsk)
+{
+    if (bestBid <= 0 || bestAsk <= 0)
+    {
+        return;
+    }
+    std::vector<std::string> currs = CSVReader::tokenise(product, '/');
+    if (currs.size() != 2)
+    {
+        return;
+    }
+    double mid = (bestBid + bestAsk) / 2;
+    std::string type;
+    double mark;
+    if (currs[1] == quoteCurrency && currs[0] != quoteCurrency)
     {
-        double outgoingAmount = sale.amount;
-        std::string outgoingCurrency = currs[0];
+        type = currs[0];
+        mark = mid;
+    }
+    else if (currs[0] == quoteCurrency && currs[1] != quoteCurrency)
+    {
+        type = currs[1];
+        mark = 1 / mid;
+    }
+    else
+    {
+        return;
+    }
 
-        double incomingAmount = sale.amount * sale.price;
-        std::string incomingCurrency = currs[1];
+    std::lock_guard<std::mutex> lock{mutex};
+    unshare();
+    PositionCost& position = state->positions[type];
+    auto it = state->currencies.find(type);
+    double quantity = it == state->currencies.end() ? 0 : it->second;
+    if (position.mark == 0)
+    {
+        // first mark: anything held with no known cost costs this much
+        position.costBasis += position.unpricedQuantity * mark;
+        position.unpricedQuantity = 0;
+        state->markedCostBasis += position.costBasis;
+        state->marketValue += quantity * mark;
+    }
+    else
+    {
+        state->marketValue += quantity * (mark - position.mark);
+    }
+    position.mark = mark;
+}
 
-        currencies[incomingCurrency] += incomingAmount;
-        currencies[outgoingCurrency] -= outgoingAmount;
+double Wallet::markOf(const std::string& type) const
+{
+    if (type == quoteCurrency)
+    {
+        return 1;
+    }
+    auto it = state->positions.find(type);
+    return it == state->positions.end() ? 0 : it->second.mark;
+}
 
+void Wallet::addQuantity(const std::string& type, double amount, double cost)
+{
+    PositionCost& position = state->positions[type];
+    if (cost < 0)
+    {
+        position.unpricedQuantity += amount;
+        return;
+    }
+    position.costBasis += cost;
+    double mark = markOf(type);
+    if (mark > 0)
+    {
+        state->marketValue += amount * mark;
+        state->markedCostBasis += cost;
     }
+}
 
-    if (sale.orderType == OrderBookType::bidsale)
+void Wallet::removeQuantity(const std::string& type, double amount, double proceeds)
+{
+    PositionCost& position = state->positions[type];
+    auto it = state->currencies.find(type);
+    double quantity = it == state->currencies.end() ? 0 : it->second;
+    double share = quantity > 0 ? std::min(1.0, amount / quantity) : 0;
+    // the quote currency always costs what it is, so it never realises anything
+    double cost = type == quoteCurrency ? amount : position.costBasis * share;
+    position.costBasis -= cost;
+    // units with no known cost are taken to have cost what they fetched,
+    // so only the priced part of the amount realises a profit or loss
+    double pricedShare = quantity > 0 ? 1 - position.unpricedQuantity / quantity : 1;
+    position.unpricedQuantity -= position.unpricedQuantity * share;
+    if (proceeds >= 0)
     {
-        double incomingAmount = sale.amount;
-        std::string incomingCurrency = currs[0];
+        double pnl = proceeds * pricedShare - cost;
+        position.realisedPnl += pnl;
+        state->realisedPnl += pnl;
+    }
+    double mark = markOf(type);
+    if (mark > 0)
+    {
+        state->marketValue -= amount * mark;
+        state->markedCostBasis -= cost;
+    }
+}
+
+double Wallet::getMarketValue() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return state->marketValue;
+}
+
+double Wallet::getUnrealisedPnl() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return state->marketValue - state->markedCostBasis;
+}
 
-        double outgoingAmount = sale.amount * sale.price;
-        std::string outgoingCurrency = currs[1];
+double Wallet::getRealisedPnl() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return state->realisedPnl;
+}
 
-        currencies[incomingCurrency] += incomingAmount;
-        currencies[outgoingCurrency] -= outgoingAmount;
+std::map<std::string, Wallet::Position> Wallet::getPositions() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    std::map<std::string, Position> result;
+    for (auto const& pair : state->currencies)
+    {
+        auto it = state->positions.find(pair.first);
+        PositionCost cost = it == state->positions.end() ? PositionCost{} : it->second;
+        result[pair.first] = Position{pair.second, cost.costBasis, markOf(pair.first), cost.realisedPnl};
     }
-}
\ No newline at end of file
+    return result;
+}
+
+const std::string& Wallet::getQuoteCurrency() const
+{
+    return quoteCurrency;
+}
@@ -1,27 +1,160 @@
+#pragma once
+
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
 #include "OrderBookEntry.h"
 
+/** A user's currency balances. Part of each balance can be held against
+ * resting orders: reserveOrder holds what an order could spend,
+ * processSale spends it as the order fills, and releaseOrder or
+ * releaseTimeframe frees whatever is left. All public functions lock the
+ * wallet, so a gateway thread can check and reserve while another thread
+ * settles sales.
+ *
+ * Each currency is also a position with an average cost basis, valued in
+ * the quote currency at the marks given to updateMark. The total value
+ * and cost are kept as running sums, adjusted by just the change on each
+ * sale, deposit or new mark.
+ *
+ * Copying a wallet is O(1): copies share one set of balances, positions
+ * and reservations, and whichever copy changes first takes its own copy
+ * of them. That makes a wallet cheap to snapshot for recovery, or to fork
+ * into many what-if branches alongside OrderBook::snapshot.
+ */
 class Wallet
 {
 public:
-    Wallet();
+    /** one currency's position, valued in the quote currency */
+    struct Position
+    {
+        double quantity;
+        /** what the quantity cost, at average cost */
+        double costBasis;
+        /** the latest mark, 0 if there has not been one */
+        double mark;
+        double realisedPnl;
+    };
+
+    Wallet(std::string quoteCurrency = "USDT");
+    /** share other's state until either changes */
+    Wallet(const Wallet& other);
+    Wallet& operator=(const Wallet& other);
     /** insert currency to the wallet */
     void insertCurrency(std::string type, double amount);
-    /** remove currency to the wallet */
+    /** remove currency to the wallet. held currency cannot be removed */
     bool removeCurrency(std::string type, double amount);
-    /** check if the wallet contains this much currency or more */
+    /** check if the wallet contains this much currency or more, held or not */
     bool containsCurrency(std::string type, double amount);
-    /** check if the wallet can cope with this ask or bid. */
-    bool canFulfilOrder(OrderBookEntry order);
+    /** check if the wallet can cope with this ask or bid out of what is not already held. */
+    bool canFulfilOrder(const OrderBookEntry& order);
+    /** check the order as canFulfilOrder does and, if it passes, hold what it
+     * could spend until it is filled or released. the order needs its orderId */
+    bool reserveOrder(const OrderBookEntry& order);
+    /** reserveOrder for a caller that already knows what the order could
+     * spend, so nothing needs to be parsed out of a product name */
+    bool reserve(unsigned long orderId, const std::string& currency, double amount,
+                 const std::string& timestamp);
+    /** give back whatever is still held for this order */
+    void releaseOrder(unsigned long orderId);
+    /** give back whatever is still held for orders placed at this timestamp,
+     * e.g. once the timeframe has been matched and they can no longer fill */
+    void releaseTimeframe(const std::string& timestamp);
+    /** keep holding for an order that carries over into a later timeframe,
+     * so releasing its old timeframe leaves it alone */
+    void moveReservation(unsigned long orderId, const std::string& timestamp);
     /** update the contents of the wallet 
-     * assumes the order was made by the owner of the wallet
+     * assumes the order was made by the owner of the wallet.
+     * if sale.orderId has a reservation, the outgoing currency comes out of
+     * it first, and only the rest out of what is available. returns false,
+     * changing nothing, if the two together cannot cover the sale
      */
-    void processSale(OrderBookEntry &sale);
+    bool processSale(const OrderBookEntry &sale);
+    /** processSale for a sale of base/quote that has already been split */
+    bool processSale(const std::string& base, const std::string& quote,
+                     OrderBookType saleType, double price, double amount,
+                     unsigned long orderId);
+
+    /** balance not held against any order */
+    double getAvailable(std::string type) const;
+    /** balance held against resting orders */
+    double getHeld(std::string type) const;
+
+    /** mark the non-quote side of a product at the mid of its top of book.
+     * only products of the quote currency against another give a mark */
+    void updateMark(const std::string& product, double bestBid, double bestAsk);
+    /** value of every marked position in the quote currency */
+    double getMarketValue() const;
+    /** market value less the cost of the marked positions */
+    double getUnrealisedPnl() const;
+    /** profit taken so far, by selling currencies above their average cost */
+    double getRealisedPnl() const;
+    std::map<std::string, Position> getPositions() const;
+    const std::string& getQuoteCurrency() const;
 
-    /** generate string representation */
+    /** generate string representation. the Value line only counts
+     * holdings that have a mark, and names any that do not */
     std::string toString();
 
+    /** a copy of every balance, keyed by currency */
+    std::map<std::string, double> getCurrencies() const;
+    /** true if every balance and every order's reservation is exactly
+     * the same as other's. costs and marks are not compared */
+    bool hasSameBalances(const Wallet& other) const;
+    /** how many wallets share this one's state, itself included */
+    size_t getShareCount() const;
+
 private:
-    std::map<std::string, double> currencies;
-};
\ No newline at end of file
+    /** what is held for one order */
+    struct Reservation
+    {
+        std::string currency;
+        double amount;
+        std::string timestamp;
+    };
+
+    /** the currency and amount an ask or bid could spend.
+     * returns false for any other order type */
+    static bool getOrderCost(const OrderBookEntry& order, std::string& currency, double& amount);
+    /** these assume the mutex is already locked, and those that change
+     * anything that unshare() has been called */
+    double available(const std::string& type) const;
+    /** the value of one unit in the quote currency, 0 if unknown */
+    double markOf(const std::string& type) const;
+    /** add to a balance, costing cost in the quote currency.
+     * cost < 0 means it is not known yet, as nothing had a mark */
+    void addQuantity(const std::string& type, double amount, double cost);
+    /** take from a balance, fetching proceeds in the quote currency.
+     * proceeds < 0 means it went at cost, e.g. a withdrawal */
+    void removeQuantity(const std::string& type, double amount, double proceeds);
+    void release(std::map<unsigned long, Reservation>::iterator it);
+    /** take our own copy of the state before changing it, if it is shared */
+    void unshare();
+
+    /** cost and mark per currency. quantities are in currencies */
+    struct PositionCost
+    {
+        double costBasis = 0;
+        /** held before there was a mark to cost it at */
+        double unpricedQuantity = 0;
+        double mark = 0;
+        double realisedPnl = 0;
+    };
+    /** everything a copy shares until it is changed */
+    struct State
+    {
+        std::map<std::string, double> currencies;
+        /** running total held per currency, so available is one lookup */
+        std::map<std::string, double> held;
+        std::map<unsigned long, Reservation> reservations;
+        std::map<std::string, PositionCost> positions;
+        /** running totals over the positions that have a mark */
+        double marketValue = 0;
+        double markedCostBasis = 0;
+        double realisedPnl = 0;
+    };
+    std::shared_ptr<State> state;
+    std::string quoteCurrency;
+    mutable std::mutex mutex;
+};
@@ -1,8 +1,1121 @@
+#include <cstdlib>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
 #include "MerkelMain.h"
+#include "Backtester.h"
+#include "BandStrategy.h"
+#include "StaticBandStrategy.h"
+#include "FeedBook.h"
+#include "FeedSink.h"
+#include "MarketDataFeed.h"
+#include "OrderGateway.h"
+#include "GatewayLoadGenerator.h"
+#include "OrderSegment.h"
+#include "ParallelReplay.h"
+#include "DifferentialReplay.h"
+#include "TradeExporter.h"
+#include "OrderRateLimiter.h"
+#include "ShardedExchange.h"
+#include "ThreadPlacement.h"
+#include "ArbitrageDetector.h"
+#include "MarketSimulator.h"
+#include "BookHistory.h"
+#include "OrderQuery.h"
+#include "Profiler.h"
+#include "TimingWheel.h"
+#include "SharedTopOfBook.h"
+#include <atomic>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <chrono>
 
-int main()
+/** the wallet every backtested strategy starts with */
+Wallet makeBacktestWallet()
 {
+    Wallet wallet;
+    wallet.insertCurrency("BTC", 10);
+    wallet.insertCurrency("ETH", 100);
+    wallet.insertCurrency("DOGE", 1000000);
+    wallet.insertCurrency("USDT", 50000);
+    return wallet;
+}
+
+/** order size for each product, in the first currency of the pair */
+std::map<std::string, double> backtestOrderSizes()
+{
+    return {{"BTC/USDT", 0.1},
+            {"DOGE/BTC", 1000},
+            {"DOGE/USDT", 1000},
+            {"ETH/BTC", 1},
+            {"ETH/USDT", 1}};
+}
+
+/** sweep BandStrategy over every product and a range of band widths */
+void runBacktest()
+{
+    OrderBook orderBook{"20200317.csv"};
+    Backtester backtester{orderBook};
+    Wallet wallet = makeBacktestWallet();
+
+    for (auto const &pair : backtestOrderSizes())
+    {
+        for (int i = 0; i < 40; ++i)
+        {
+            double band = 0.0001 * i;
+            backtester.addStrategy(std::unique_ptr<TradingStrategy>{
+                                       new BandStrategy{pair.first, band, pair.second}},
+                                   wallet);
+        }
+    }
+
+    std::vector<BacktestResult> results = backtester.run();
+    backtester.printResults(results);
+}
+
+/** the same sweep through the statically dispatched strategy API,
+ * with a much finer band step */
+void runStaticBacktest()
+{
+    OrderBook orderBook{"20200317.csv"};
+    Backtester backtester{orderBook};
+
+    const int perProduct = 1000;
+    std::vector<StaticBandStrategy> strategies;
+    for (auto const &pair : backtestOrderSizes())
+    {
+        int product = backtester.getProductIndex(pair.first);
+        if (product < 0)
+            continue;
+        for (int i = 0; i < perProduct; ++i)
+        {
+            strategies.push_back(StaticBandStrategy{unsigned(product), pair.first,
+                                                    0.000004 * i, pair.second});
+        }
+    }
+
+    std::vector<BacktestResult> results = backtester.runStatic(strategies, makeBacktestWallet());
+    // too many to list, so just show the best one per product and the timing
+    std::vector<BacktestResult> best;
+    for (size_t i = 0; i < results.size(); i += perProduct)
+    {
+        size_t top = i;
+        for (size_t j = i; j < i + perProduct && j < results.size(); ++j)
+        {
+            if (results[j].pnl > results[top].pnl)
+                top = j;
+        }
+        best.push_back(results[top]);
+    }
+    backtester.printResults(best);
+}
+
+/** match every timeframe of the book, publishing it all to sink.
+ * returns the number of messages */
+uint64_t publishAllTimeframes(OrderBook &orderBook, FeedSink &sink)
+{
+    MarketDataFeed feed{sink};
+    orderBook.setFeed(&feed);
+
+    std::string time = orderBook.getEarliestTime();
+    do
+    {
+        for (std::string const &p : orderBook.getKnownProducts())
+        {
+            orderBook.matchAsksToBids(p, time);
+        }
+        time = orderBook.getNextTime(time);
+    } while (time != orderBook.getEarliestTime());
+    orderBook.setFeed(nullptr);
+    return feed.getSequence();
+}
+
+/** match every timeframe once with the feed going to filename,
+ * then read the file back and rebuild the book from it */
+void runFeed(std::string filename)
+{
+    OrderBook orderBook{"20200317.csv"};
+    {
+        FileFeedSink sink{filename};
+        if (!sink.isOpen())
+        {
+            std::cout << "Could not open " << filename << std::endl;
+            return;
+        }
+        uint64_t published = publishAllTimeframes(orderBook, sink);
+        std::cout << "Published " << published << " messages to " << filename << std::endl;
+    }
+
+    std::ifstream file{filename, std::ios::binary};
+    std::vector<char> data{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    std::vector<FeedMessage> messages;
+    size_t used = MarketDataFeed::decode(data.data(), data.size(), messages);
+
+    FeedBook book;
+    for (const FeedMessage &m : messages)
+    {
+        book.apply(m);
+    }
+    std::cout << "Decoded " << messages.size() << " messages (" << used << " of "
+              << data.size() << " bytes), " << book.getTradeCount() << " trades, "
+              << book.getGapCount() << " sequence gaps, "
+              << book.getOpenOrderCount() << " orders left open" << std::endl;
+}
+
+/** serve orders over a socket instead of the stdin menu */
+void runGateway(std::string address, const std::vector<std::string>& classes)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet;
+    wallet.insertCurrency("BTC", 10);
+
+    TopOfBookPublisher topOfBook{"/merkelrex-top"};
+    if (topOfBook.isOpen())
+    {
+        orderBook.setTopOfBook(&topOfBook);
+    }
+
+    OrderGateway gateway{orderBook, wallet};
+    if (!gateway.listenOn(address))
+    {
+        return;
+    }
+    // each class is name:ordersPerSecond:burst[:peer,peer...], the first
+    // being the default for any peer not listed, e.g. maker:1000:100:uid=1000
+    OrderRateLimiter limiter;
+    for (const std::string &spec : classes)
+    {
+        std::vector<std::string> tokens = CSVReader::tokenise(spec, ':');
+        if (tokens.size() != 3 && tokens.size() != 4)
+            throw std::exception{};
+        int classId = limiter.addClass({tokens[0], std::stod(tokens[1]), std::stod(tokens[2])});
+        std::cout << "OrderGateway rate limit class " << tokens[0] << ": " << tokens[1]
+                  << " orders/s, burst " << tokens[2] << std::endl;
+        if (tokens.size() == 4)
+        {
+            for (const std::string &peer : CSVReader::tokenise(tokens[3], ','))
+                gateway.setPeerClass(peer, classId);
+        }
+    }
+    if (!classes.empty())
+    {
+        gateway.setRateLimiter(&limiter);
+    }
+    std::cout << "OrderGateway listening on " << address << std::endl;
+    gateway.run();
+}
+
+/** rough heap footprint of some orders, strings included */
+size_t estimateBytes(const std::vector<OrderBookEntry> &orders)
+{
+    size_t bytes = orders.capacity() * sizeof(OrderBookEntry);
+    for (const OrderBookEntry &e : orders)
+    {
+        // strings longer than the small-string buffer live on the heap
+        for (const std::string *s : {&e.timestamp, &e.product, &e.username})
+        {
+            if (s->capacity() > 15)
+                bytes += s->capacity() + 1;
+        }
+    }
+    return bytes;
+}
+
+/** compress every timeframe but the last, check it comes back exactly
+ * and compare the memory used and a scan over each form */
+void runHistory()
+{
+    OrderBook orderBook{"20200317.csv"};
+    std::vector<OrderBookEntry> original = orderBook.getAllOrders();
+    size_t before = estimateBytes(original);
+
+    std::string last = orderBook.getEarliestTime();
+    for (std::string t = orderBook.getNextTime(last); t != orderBook.getEarliestTime(); t = orderBook.getNextTime(t))
+    {
+        last = t;
+    }
+    if (!orderBook.compactBefore(last))
+    {
+        std::cout << "Could not compress the order history" << std::endl;
+        return;
+    }
+
+    size_t compressed = 0;
+    std::vector<OrderBookEntry> rebuilt;
+    for (const OrderSegment &segment : orderBook.getHistory())
+    {
+        compressed += segment.getCompressedBytes();
+        std::vector<OrderBookEntry> entries = segment.decompress();
+        rebuilt.insert(rebuilt.end(), entries.begin(), entries.end());
+    }
+    size_t history = rebuilt.size();
+    std::vector<OrderBookEntry> live = orderBook.getAllOrders();
+    rebuilt.insert(rebuilt.end(), live.begin(), live.end());
+
+    bool same = rebuilt.size() == original.size();
+    for (size_t i = 0; same && i < rebuilt.size(); ++i)
+    {
+        const OrderBookEntry &a = original[i];
+        const OrderBookEntry &b = rebuilt[i];
+        same = a.price == b.price && a.amount == b.amount && a.timestamp == b.timestamp &&
+               a.product == b.product && a.orderType == b.orderType &&
+               a.username == b.username && a.orderId == b.orderId;
+    }
+
+    std::cout << history << " orders in " << orderBook.getHistory().size() << " segments: "
+              << compressed << " bytes compressed vs " << estimateBytes({original.begin(), original.begin() + history})
+              << " uncompressed (" << double(compressed) / history << " vs "
+              << double(before) / original.size() << " bytes/order)" << std::endl;
+    std::cout << "Round trip " << (same ? "matches" : "DOES NOT match") << " the original" << std::endl;
+
+    // total ask volume per product, scanning the compressed columns directly
+    std::map<std::string, double> volume;
+    for (const OrderSegment &segment : orderBook.getHistory())
+    {
+        OrderSegment::Reader reader = segment.reader();
+        OrderRecord record;
+        while (reader.next(record))
+        {
+            if (record.orderType == OrderBookType::ask)
+                volume[segment.getProducts()[record.product]] += record.amount;
+        }
+    }
+    for (auto const &pair : volume)
+    {
+        std::cout << pair.first << " ask volume in history: " << pair.second << std::endl;
+    }
+}
+
+/** give simuser a crossing bid and ask at the top of every product in
+ * every timeframe, reserved in wallet, so replays have fills to settle */
+void placeCrossingSimuserOrders(OrderBook& orderBook, Wallet& wallet)
+{
+    std::vector<std::string> timestamps;
+    for (const OrderSpan &frame : orderBook.getTimeframes())
+    {
+        timestamps.push_back(frame[0].timestamp);
+    }
+    for (const std::string &timestamp : timestamps)
+    {
+        for (auto const &pair : backtestOrderSizes())
+        {
+            double bestAsk = OrderBook::getLowPrice(orderBook.getOrderView(OrderBookType::ask, pair.first, timestamp));
+            double bestBid = OrderBook::getHighPrice(orderBook.getOrderView(OrderBookType::bid, pair.first, timestamp));
+            if (bestAsk == 0 || bestBid == 0)
+                continue;
+            OrderBookEntry bid{bestAsk, pair.second, timestamp, pair.first, OrderBookType::bid, "simuser"};
+            OrderBookEntry ask{bestBid, pair.second, timestamp, pair.first, OrderBookType::ask, "simuser"};
+            for (OrderBookEntry *order : {&bid, &ask})
+            {
+                order->orderId = orderBook.newOrderId();
+                if (wallet.reserveOrder(*order))
+                    orderBook.insertOrder(*order);
+            }
+        }
+    }
+}
+
+/** place a crossing simuser bid and ask in every timeframe, then replay
+ * the whole file once on one thread and once across threads and check
+ * both leave the wallet in the same state */
+void runReplay(unsigned int threads)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet = makeBacktestWallet();
+    placeCrossingSimuserOrders(orderBook, wallet);
+
+    Wallet sequentialWallet = wallet;
+    Wallet parallelWallet = wallet;
+    ParallelReplay replay{orderBook};
+    for (unsigned int n : {1u, threads})
+    {
+        ReplayResult result = replay.run(n == 1 ? sequentialWallet : parallelWallet, n);
+        std::cout << result.threads << " thread(s): " << result.timeframes << " timeframes, "
+                  << result.fills << " fills (" << result.walletFills << " for simuser), matched in "
+                  << result.matchSeconds * 1000 << " ms, settled in "
+                  << result.settleSeconds * 1000 << " ms" << std::endl;
+    }
+    bool same = sequentialWallet.toString() == parallelWallet.toString();
+    std::cout << "Wallets " << (same ? "match" : "DO NOT match") << std::endl;
+    std::cout << parallelWallet.toString() << std::endl;
+}
+
+/** walk every timeframe and print the triangular arbitrage loops in it */
+void runArbitrage(double minProfit)
+{
+    OrderBook orderBook{"20200317.csv"};
+    ArbitrageDetector detector{orderBook.getKnownProducts(), minProfit};
+    std::cout << "Watching " << detector.getCycleCount() << " currency cycles" << std::endl;
+
+    for (const OrderSpan &frame : orderBook.getTimeframes())
+    {
+        std::vector<ArbitrageOpportunity> found;
+        detector.onTimeframe(orderBook, frame[0].timestamp, found);
+        for (const ArbitrageOpportunity &o : found)
+        {
+            std::cout << o.timestamp << " ";
+            for (size_t i = 0; i < o.path.size(); ++i)
+            {
+                std::cout << (i > 0 ? " -> " : "") << o.path[i];
+            }
+            std::cout << " via " << o.products[0] << ", " << o.products[1] << ", " << o.products[2]
+                      << ": " << (o.rate - 1) * 100 << "%" << std::endl;
+        }
+    }
+    std::cout << detector.getCyclesPriced() << " cycles priced, detection took "
+              << detector.getMeanLatencyMicros() << " us on average, "
+              << detector.getMaxLatencyMicros() << " us at most" << std::endl;
+}
+
+/** run a population of agents over the whole file. agents are split
+ * one market maker : two noise traders : one momentum trader */
+void runSimulation(unsigned int threads, int agents)
+{
+    OrderBook orderBook{"20200317.csv"};
+    SimulationConfig config;
+    config.threads = threads;
+    config.marketMakers = agents / 4;
+    config.momentumTraders = agents / 4;
+    config.noiseTraders = agents - config.marketMakers - config.momentumTraders;
+
+    MarketSimulator simulator{orderBook, config, makeBacktestWallet()};
+    simulator.printResult(simulator.run());
+}
+
+/** rebuild the book as it stood at timestamp from the feed, from the
+ * nearest checkpoint and by replaying from the start, and compare */
+void runBookAt(std::string timestamp)
+{
+    OrderBook orderBook{"20200317.csv"};
+    MemoryFeedSink sink;
+    publishAllTimeframes(orderBook, sink);
+    std::vector<FeedMessage> messages;
+    MarketDataFeed::decode(sink.getData().data(), sink.getData().size(), messages);
+
+    BookHistory history{256};
+    for (const FeedMessage &m : messages)
+    {
+        history.append(m);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    FeedBook book = history.bookAt(timestamp);
+    double checkpointMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t deltas = history.getLastDeltaCount();
+
+    // the same from the very start, with no checkpoints
+    start = std::chrono::steady_clock::now();
+    BookHistory unindexed{messages.size() + 1};
+    for (const FeedMessage &m : messages)
+    {
+        unindexed.append(m);
+    }
+    FeedBook replayed = unindexed.bookAt(timestamp);
+    double replayMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Book at " << timestamp << ": " << book.getOpenOrderCount() << " open orders" << std::endl;
+    for (const std::string &product : book.getProducts())
+    {
+        std::cout << product << " best bid " << book.getBestBid(product)
+                  << " best ask " << book.getBestAsk(product) << std::endl;
+    }
+    bool same = book.getOpenOrderCount() == replayed.getOpenOrderCount();
+    for (const std::string &product : book.getProducts())
+    {
+        same = same && book.getBestBid(product) == replayed.getBestBid(product) &&
+               book.getBestAsk(product) == replayed.getBestAsk(product);
+    }
+    std::cout << history.getCheckpointCount() << " checkpoints over " << history.getMessageCount()
+              << " messages. rebuilt from a checkpoint plus " << deltas << " deltas in "
+              << checkpointMillis << " ms, vs " << replayMillis << " ms replaying from the start ("
+              << (same ? "same book" : "DIFFERENT book") << ")" << std::endl;
+}
+
+void printQueryRows(const std::vector<QueryRow> &rows)
+{
+    for (const QueryRow &row : rows)
+    {
+        std::cout << row.bucket << " " << row.product << " " << row.type << ": count " << row.count
+                  << " volume " << row.sumAmount << " min " << row.minPrice << " max " << row.maxPrice
+                  << " avg " << row.avgPrice() << " vwap " << row.vwap() << std::endl;
+    }
+}
+
+/** a couple of example queries over the file, then the first one again
+ * over the file repeated copies times to see how it scales */
+void runQuery(int copies)
+{
+    OrderBook orderBook{"20200317.csv"};
+    OrderQuery query{orderBook};
+
+    std::cout << "Hourly bid volume per product" << std::endl;
+    QuerySpec hourlyBids;
+    hourlyBids.types = {OrderBookType::bid};
+    hourlyBids.byProduct = true;
+    hourlyBids.bucketMicros = 3600ull * 1000000;
+    printQueryRows(query.run(hourlyBids));
+
+    std::cout << "ETH/USDT per side, in 10 second buckets" << std::endl;
+    QuerySpec ethBySide;
+    ethBySide.products = {"ETH/USDT"};
+    ethBySide.byType = true;
+    ethBySide.bucketMicros = 10ull * 1000000;
+    printQueryRows(query.run(ethBySide));
+
+    OrderQuery big;
+    for (int i = 0; i < copies; ++i)
+    {
+        big.addOrders(orderBook.getAllOrders());
+    }
+    for (unsigned int threads : {1u, 0u})
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<QueryRow> rows = big.run(hourlyBids, threads);
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Hourly bid volume over " << big.size() << " rows, "
+                  << (threads == 0 ? "all cores" : "1 thread") << ": " << rows.size() << " groups in "
+                  << millis << " ms" << std::endl;
+    }
+}
+
+/** time market, IOC and FOK orders against every timeframe, each kind on
+ * a fresh copy of the book so they all see the same liquidity */
+void runImmediateBenchmark(int ordersPerKind)
+{
+    OrderBook source{"20200317.csv"};
+    std::vector<std::string> timestamps;
+    for (const OrderSpan &frame : source.getTimeframes())
+    {
+        timestamps.push_back(frame[0].timestamp);
+    }
+    const std::vector<std::string> products = source.getKnownProducts();
+    std::map<std::string, double> sizes = backtestOrderSizes();
+
+    std::vector<std::pair<std::string, OrderExecution>> kinds{{"market", OrderExecution::market},
+                                                              {"ioc", OrderExecution::immediateOrCancel},
+                                                              {"fok", OrderExecution::fillOrKill}};
+    for (auto const &kind : kinds)
+    {
+        OrderBook orderBook = source;
+        MatchArena arena;
+        std::vector<OrderBookEntry> sales;
+        std::vector<double> latencies;
+        double filled = 0;
+        double wanted = 0;
+        for (int i = 0; i < ordersPerKind; ++i)
+        {
+            const std::string &timestamp = timestamps[i % timestamps.size()];
+            const std::string &product = products[(i / timestamps.size()) % products.size()];
+            OrderBookType side = i % 2 == 0 ? OrderBookType::bid : OrderBookType::ask;
+            // limit price a little through the other side's best
+            double bestAsk = OrderBook::getLowPrice(orderBook.getOrderView(OrderBookType::ask, product, timestamp));
+            double bestBid = OrderBook::getHighPrice(orderBook.getOrderView(OrderBookType::bid, product, timestamp));
+            double price = side == OrderBookType::bid ? bestAsk * 1.001 : bestBid * 0.999;
+            OrderBookEntry order{price, sizes[product], timestamp, product, side, "simuser"};
+            order.execution = kind.second;
+            wanted += order.amount;
+
+            auto start = std::chrono::steady_clock::now();
+            filled += orderBook.executeImmediate(order, arena, sales);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            arena.reset();
+            sales.clear();
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << kind.first << ": " << ordersPerKind << " orders, " << (wanted > 0 ? 100 * filled / wanted : 0)
+                  << "% of the amount filled, latency p50 " << latencies[latencies.size() / 2]
+                  << " us p99 " << latencies[latencies.size() * 99 / 100]
+                  << " us max " << latencies.back() << " us" << std::endl;
+    }
+    std::cout << Profiler::instance().toString();
+}
+
+/** schedule timers spread over an hour, cancel a tenth of them and run
+ * the clock through in 5 second steps, timing each part per timer */
+void runTimerBenchmark(int count)
+{
+    TimingWheel wheel{0};
+    std::mt19937_64 rng{1};
+    std::uniform_int_distribution<uint64_t> due{1, 3600ull * 1000000};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TimerId> ids;
+    ids.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        ids.push_back(wheel.schedule(due(rng), 0, i));
+    }
+    auto scheduled = std::chrono::steady_clock::now();
+
+    int cancelled = 0;
+    for (size_t i = 0; i < ids.size(); i += 10)
+    {
+        cancelled += wheel.cancel(ids[i]);
+    }
+    auto cancelledAt = std::chrono::steady_clock::now();
+
+    std::vector<TimerEvent> expired;
+    expired.reserve(count);
+    bool inOrder = true;
+    for (uint64_t now = 0; wheel.getPendingCount() > 0; now += 5000000)
+    {
+        size_t before = expired.size();
+        wheel.advance(now, expired);
+        for (size_t i = before; i < expired.size(); ++i)
+        {
+            inOrder = inOrder && expired[i].dueMicros <= now && expired[i].dueMicros + 5000000 > now;
+        }
+    }
+    auto fired = std::chrono::steady_clock::now();
+
+    auto nanosPer = [](std::chrono::steady_clock::duration d, size_t n)
+    { return n == 0 ? 0 : std::chrono::duration<double, std::nano>(d).count() / n; };
+    std::cout << count << " timers: schedule " << nanosPer(scheduled - start, count) << " ns each, cancel "
+              << nanosPer(cancelledAt - scheduled, cancelled) << " ns each, expire "
+              << nanosPer(fired - cancelledAt, expired.size()) << " ns each (" << expired.size() << " fired"
+              << (inOrder ? ", each in the step it was due" : ", SOME EARLY OR LATE") << ")" << std::endl;
+}
+
+/** print what a running gateway has published to /merkelrex-top */
+void runTopOfBook()
+{
+    TopOfBookReader reader{"/merkelrex-top"};
+    if (!reader.isOpen())
+    {
+        std::cout << "Nothing published at /merkelrex-top; start a gateway first" << std::endl;
+        return;
+    }
+    std::vector<std::string> products = reader.getProducts();
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        TopOfBookQuote quote;
+        if (!reader.read(i, quote))
+        {
+            std::cout << products[i] << " is being updated, try again" << std::endl;
+            continue;
+        }
+        std::cout << products[i] << " bid " << quote.bestBid << " ask " << quote.bestAsk
+                  << " last " << quote.lastPrice << " x " << quote.lastAmount
+                  << " (" << quote.version << " updates)" << std::endl;
+    }
+}
+
+/** one thread publishes a quote every couple of microseconds while readers
+ * poll for them, measuring the cost of a write and how long each update
+ * takes to be seen. readers only see every update given cores of their own */
+void runTopOfBookBenchmark(int updates, int readers)
+{
+    TopOfBookPublisher publisher{"/merkelrex-top-bench"};
+    if (!publisher.isOpen())
+    {
+        std::cout << "Could not create /merkelrex-top-bench" << std::endl;
+        return;
+    }
+    publisher.publishQuote("ETH/BTC", 0, 0);
+
+    std::atomic<bool> done{false};
+    std::vector<std::vector<double>> latencies(readers);
+    std::vector<unsigned long> reads(readers, 0);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r)
+    {
+        threads.emplace_back([r, &done, &latencies, &reads]()
+        {
+            TopOfBookReader reader{"/merkelrex-top-bench"};
+            uint64_t seen = 0;
+            TopOfBookQuote quote;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                ++reads[r];
+                if (reader.getVersion(0) == seen)
+                {
+                    // let the writer have the core if it shares ours
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (!reader.read(0, quote))
+                    continue;
+                seen = quote.version;
+                latencies[r].push_back((TopOfBookPublisher::nowNanos() - quote.publishNanos) / 1000.0);
+            }
+        });
+    }
+
+    // publish one update every couple of microseconds, timing just the writes
+    std::chrono::steady_clock::duration writing{0};
+    for (int i = 0; i < updates; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        publisher.publishQuote("ETH/BTC", 0.0218 + i * 1e-9, 0.0219 + i * 1e-9);
+        auto written = std::chrono::steady_clock::now();
+        writing += written - start;
+        while (std::chrono::steady_clock::now() - written < std::chrono::microseconds(2))
+        {
+        }
+    }
+    double writeNanos = std::chrono::duration<double, std::nano>(writing).count() / updates;
+    done = true;
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+
+    std::vector<double> all;
+    unsigned long totalReads = 0;
+    for (int r = 0; r < readers; ++r)
+    {
+        all.insert(all.end(), latencies[r].begin(), latencies[r].end());
+        totalReads += reads[r];
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << updates << " updates at " << writeNanos << " ns each, " << readers << " readers polled "
+              << totalReads << " times and saw " << all.size() << " updates" << std::endl;
+    if (!all.empty())
+    {
+        std::cout << "publish to read latency p50 " << all[all.size() / 2] << " us p99 "
+                  << all[all.size() * 99 / 100] << " us max " << all.back() << " us" << std::endl;
+    }
+}
+
+/** replay the file through matchAsksToBids and the arena matchers and
+ * check they agree. returns false if any engine differs */
+bool runDifferentialReplay(unsigned int repeats)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet = makeBacktestWallet();
+    placeCrossingSimuserOrders(orderBook, wallet);
+
+    DifferentialReplay harness{orderBook, wallet};
+    MatchArena arena;
+    harness.addEngine("matchProduct", [&arena](OrderBook &book, const std::string &product,
+                                               const std::string &timestamp, std::vector<OrderBookEntry> &sales)
+    {
+        arena.reset();
+        std::pmr::vector<Fill> fills{&arena};
+        book.matchProduct(product, timestamp, arena, fills);
+        for (const Fill &fill : fills)
+            sales.push_back(fill.toSale());
+    });
+    harness.addEngine("matchProduct(span)", [&arena](OrderBook &book, const std::string &product,
+                                                     const std::string &timestamp, std::vector<OrderBookEntry> &sales)
+    {
+        arena.reset();
+        std::pmr::vector<Fill> fills{&arena};
+        book.matchProduct(product, book.getOrdersAt(timestamp), arena, fills);
+        for (const Fill &fill : fills)
+            sales.push_back(fill.toSale());
+    });
+
+    std::vector<EngineReport> reports = harness.run(repeats);
+    DifferentialReplay::printReport(reports);
+    for (const EngineReport &report : reports)
+    {
+        if (!report.matchesReference())
+            return false;
+    }
+    return true;
+}
+
+/** replay the file once, collecting what an export would write, then
+ * write it repeats times, first the std::ofstream way and then through
+ * TradeExporter, and compare their throughput */
+void runExport(std::string filename, ExportFormat format, int repeats, bool background)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet = makeBacktestWallet();
+    placeCrossingSimuserOrders(orderBook, wallet);
+
+    std::vector<OrderBookEntry> sales;
+    std::vector<WalletChange> changes;
+    std::vector<TimeframeStats> stats;
+    MatchArena arena;
+    for (const OrderSpan &frame : orderBook.getTimeframes())
+    {
+        const std::string &timestamp = frame[0].timestamp;
+        for (const std::string &product : orderBook.getKnownProducts())
+        {
+            arena.reset();
+            std::pmr::vector<Fill> fills{&arena};
+            orderBook.matchProduct(product, frame, arena, fills);
+            TimeframeStats s;
+            s.timestamp = timestamp;
+            s.product = product;
+            for (const Fill &fill : fills)
+            {
+                sales.push_back(fill.toSale());
+                ++s.sales;
+                s.volume += fill.amount;
+                s.turnover += fill.price * fill.amount;
+                s.low = s.sales == 1 ? fill.price : std::min(s.low, fill.price);
+                s.high = std::max(s.high, fill.price);
+                if (sales.back().username != "simuser")
+                    continue;
+                std::map<std::string, double> before = wallet.getCurrencies();
+                wallet.processSale(sales.back());
+                for (auto const &pair : wallet.getCurrencies())
+                {
+                    double change = pair.second - before[pair.first];
+                    if (change != 0)
+                        changes.push_back({timestamp, pair.first, change, pair.second});
+                }
+            }
+            stats.push_back(s);
+        }
+        wallet.releaseTimeframe(timestamp);
+    }
+    std::cout << "Collected " << sales.size() << " sales, " << changes.size() << " wallet changes and "
+              << stats.size() << " timeframe stats; writing them " << repeats << " times" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long baselineBytes = 0;
+    {
+        std::ofstream out{filename, std::ios::trunc};
+        for (int i = 0; i < repeats; ++i)
+        {
+            for (const OrderBookEntry &sale : sales)
+            {
+                std::string line = "sale," + sale.timestamp + "," + sale.product + "," +
+                                   (sale.orderType == OrderBookType::bidsale ? "bidsale" : "asksale") + "," +
+                                   std::to_string(sale.price) + "," + std::to_string(sale.amount) + "," +
+                                   sale.username + "," + std::to_string(sale.orderId) + "\n";
+                baselineBytes += line.size();
+                out << line;
+            }
+            for (const WalletChange &change : changes)
+            {
+                std::string line = "wallet," + change.timestamp + "," + change.currency + "," +
+                                   std::to_string(change.change) + "," + std::to_string(change.balance) + "\n";
+                baselineBytes += line.size();
+                out << line;
+            }
+            for (const TimeframeStats &s : stats)
+            {
+                std::string line = "stats," + s.timestamp + "," + s.product + "," + std::to_string(s.sales) + "," +
+                                   std::to_string(s.volume) + "," +
+                                   std::to_string(s.volume > 0 ? s.turnover / s.volume : 0) + "," +
+                                   std::to_string(s.low) + "," + std::to_string(s.high) + "\n";
+                baselineBytes += line.size();
+                out << line;
+            }
+        }
+    }
+    double baselineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "std::to_string + ofstream: " << baselineBytes / 1e6 << " MB in " << baselineSeconds * 1000
+              << " ms (" << baselineBytes / 1e6 / baselineSeconds << " MB/s)" << std::endl;
+
+    FileFeedSink sink{filename};
+    if (!sink.isOpen())
+    {
+        std::cout << "Could not open " << filename << std::endl;
+        return;
+    }
+    start = std::chrono::steady_clock::now();
+    unsigned long long bytes = 0;
+    unsigned long records = 0;
+    {
+        TradeExporter exporter{sink, format, background};
+        for (int i = 0; i < repeats; ++i)
+        {
+            for (const OrderBookEntry &sale : sales)
+                exporter.exportSale(sale);
+            for (const WalletChange &change : changes)
+                exporter.exportWalletChange(change);
+            for (const TimeframeStats &s : stats)
+                exporter.exportStats(s);
+        }
+        exporter.flush();
+        bytes = exporter.getBytes();
+        records = exporter.getRecords();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "TradeExporter" << (background ? " (background writer)" : "") << ": " << records << " records, "
+              << bytes / 1e6 << " MB in " << seconds * 1000 << " ms (" << bytes / 1e6 / seconds << " MB/s) to "
+              << filename << std::endl;
+}
+
+/** time tryAcquire on the reject path, each thread on its own account,
+ * and with every thread sharing one account at a real clock */
+void runRateLimitBenchmark(unsigned int threads, int attempts)
+{
+    OrderRateLimiter limiter;
+    int retail = limiter.addClass({"retail", 100, 10});
+    int maker = limiter.addClass({"maker", 100000, 1000});
+
+    std::vector<int> accounts;
+    for (unsigned int t = 0; t < threads; ++t)
+        accounts.push_back(limiter.getAccount("retail" + std::to_string(t), retail));
+    std::vector<std::thread> workers;
+    std::vector<double> nanosPerCall(threads);
+    int64_t now = OrderRateLimiter::nowNanos();
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]
+        {
+            // the clock stands still, so after the burst every call is a reject
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < attempts; ++i)
+                limiter.tryAcquire(accounts[t], now);
+            nanosPerCall[t] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / attempts;
+        });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    workers.clear();
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        RateLimitCounters counters = limiter.getAccountCounters(accounts[t]);
+        std::cout << "retail" << t << ": " << counters.accepted << " accepted, " << counters.rejected
+                  << " rejected, " << nanosPerCall[t] << " ns per call" << std::endl;
+    }
+
+    int shared = limiter.getAccount("market-maker", maker);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]
+        {
+            for (int i = 0; i < attempts; ++i)
+                limiter.tryAcquire(shared);
+        });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    RateLimitCounters counters = limiter.getAccountCounters(shared);
+    std::cout << "market-maker shared by " << threads << " threads: " << counters.accepted << " accepted, "
+              << counters.rejected << " rejected in " << seconds * 1000 << " ms ("
+              << counters.accepted / seconds << " accepted/s against a limit of 100000/s, "
+              << seconds * 1e9 / (attempts * double(threads)) << " ns per call)" << std::endl;
+
+    for (int c : {retail, maker})
+    {
+        RateLimitCounters totals = limiter.getClassCounters(c);
+        std::cout << "class " << limiter.getClasses()[c].name << ": " << totals.accepted << " accepted, "
+                  << totals.rejected << " rejected" << std::endl;
+    }
+}
+
+/** replay the file in one process per shard of the products and check
+ * the wallet comes out as it does replaying in this process */
+bool runSharded(unsigned int shards)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet = makeBacktestWallet();
+    placeCrossingSimuserOrders(orderBook, wallet);
+
+    Wallet expected = wallet;
+    ReplayResult replayed = ParallelReplay{orderBook}.run(expected, 1);
+    std::cout << "In process: " << replayed.fills << " sales (" << replayed.walletFills << " for simuser) in "
+              << (replayed.matchSeconds + replayed.settleSeconds) * 1000 << " ms" << std::endl;
+
+    ShardedExchange exchange{orderBook, shards};
+    for (auto const &pair : exchange.getShardOfProduct())
+        std::cout << pair.first << " -> shard " << pair.second << std::endl;
+    ShardedResult result = exchange.run(wallet);
+    if (!result.ok)
+    {
+        std::cout << "Sharded run failed" << std::endl;
+        return false;
+    }
+    std::cout << result.shards << " shard(s): " << result.orders << " orders over " << result.timeframes
+              << " timeframes, " << result.sales << " sales (" << result.walletSales << " for simuser) in "
+              << result.seconds * 1000 << " ms" << std::endl;
+    bool same = result.balances == expected.getCurrencies();
+    std::cout << "Wallets " << (same ? "match" : "DO NOT match") << std::endl;
+    std::cout << result.wallet << std::endl;
+    return same;
+}
+
+/** fork the book and wallet into what-if branches that each add one
+ * order, and compare snapshotting with copying everything */
+void runSnapshots(int branches)
+{
+    OrderBook orderBook{"20200317.csv"};
+    Wallet wallet = makeBacktestWallet();
+    placeCrossingSimuserOrders(orderBook, wallet);
+
+    const int copies = 1000;
+    auto start = std::chrono::steady_clock::now();
+    size_t copied = 0;
+    for (int i = 0; i < copies; ++i)
+    {
+        std::vector<OrderBookEntry> orders = orderBook.getAllOrders();
+        std::map<std::string, double> currencies = wallet.getCurrencies();
+        copied += orders.size() + currencies.size();
+    }
+    double copyNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / copies;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < copies; ++i)
+    {
+        OrderBook book = orderBook.snapshot();
+        Wallet branchWallet = wallet;
+        copied += book.getKnownProducts().size();
+    }
+    double snapshotNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / copies;
+    std::cout << "Copying every order and balance: " << copyNanos / 1000 << " us; snapshot of book and wallet: "
+              << snapshotNanos / 1000 << " us" << std::endl;
+
+    // what the untouched book settles to, to check the branches leave it alone
+    Wallet baseline = wallet;
+    ParallelReplay{orderBook}.run(baseline, 1);
+
+    std::vector<std::string> timestamps;
+    for (const OrderSpan &frame : orderBook.getTimeframes())
+        timestamps.push_back(frame[0].timestamp);
+    std::vector<std::pair<OrderBook, Wallet>> forks;
+    for (int b = 0; b < branches; ++b)
+    {
+        forks.emplace_back(orderBook.snapshot(), wallet);
+        OrderBook &book = forks.back().first;
+        Wallet &branchWallet = forks.back().second;
+        // each branch buys a little more ETH in one timeframe, bidding up
+        // to the dearest ask so that it fills
+        const std::string &timestamp = timestamps[b % timestamps.size()];
+        double topAsk = OrderBook::getHighPrice(book.getOrderView(OrderBookType::ask, "ETH/USDT", timestamp));
+        OrderBookEntry bid{topAsk, 0.5 * (b + 1), timestamp, "ETH/USDT", OrderBookType::bid, "simuser"};
+        bid.orderId = book.newOrderId();
+        if (topAsk > 0 && branchWallet.reserveOrder(bid))
+            book.insertOrder(bid);
+        ParallelReplay{book}.run(branchWallet, 1);
+        std::cout << "Branch " << b << ": bid " << bid.amount << " ETH at " << timestamp << ", shares "
+                  << book.getSharedTimeframeCount() << "/" << timestamps.size() << " timeframes, ETH "
+                  << branchWallet.getCurrencies()["ETH"] << ", USDT " << branchWallet.getCurrencies()["USDT"]
+                  << std::endl;
+    }
+
+    Wallet again = wallet;
+    ParallelReplay{orderBook}.run(again, 1);
+    std::cout << "Original book " << (again.toString() == baseline.toString() ? "unchanged" : "CHANGED")
+              << " by the branches; " << orderBook.getSharedTimeframeCount() << "/" << timestamps.size()
+              << " of its timeframes still shared" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    // e.g. MERKELREX_THREADS=matcher=2-3,gateway=1,logger=0,isolate=matcher
+    const char *placement = std::getenv("MERKELREX_THREADS");
+    if (placement != nullptr)
+    {
+        ThreadPlacement::instance().configure(placement);
+        std::atexit([]
+        {
+            std::cout << "ThreadPlacement:" << std::endl;
+            std::cout << ThreadPlacement::instance().toString();
+        });
+    }
+    if (mode == "backtest")
+    {
+        runBacktest();
+        return 0;
+    }
+    if (mode == "gateway" && argc > 2)
+    {
+        runGateway(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+        return 0;
+    }
+    if (mode == "loadgen" && argc > 2)
+    {
+        int clients = argc > 3 ? std::stoi(argv[3]) : 8;
+        int orders = argc > 4 ? std::stoi(argv[4]) : 10000;
+        GatewayLoadGenerator{argv[2], clients, orders}.run();
+        return 0;
+    }
+    if (mode == "replay")
+    {
+        runReplay(argc > 2 ? std::stoi(argv[2]) : 0);
+        return 0;
+    }
+    if (mode == "arbitrage")
+    {
+        runArbitrage(argc > 2 ? std::stod(argv[2]) : 0);
+        return 0;
+    }
+    if (mode == "simulate")
+    {
+        unsigned int threads = argc > 2 ? std::stoi(argv[2]) : 0;
+        int agents = argc > 3 ? std::stoi(argv[3]) : 4000;
+        runSimulation(threads, agents);
+        return 0;
+    }
+    if (mode == "book" && argc > 2)
+    {
+        runBookAt(argv[2]);
+        return 0;
+    }
+    if (mode == "query")
+    {
+        runQuery(argc > 2 ? std::stoi(argv[2]) : 300);
+        return 0;
+    }
+    if (mode == "immediate")
+    {
+        runImmediateBenchmark(argc > 2 ? std::stoi(argv[2]) : 10000);
+        return 0;
+    }
+    if (mode == "timers")
+    {
+        runTimerBenchmark(argc > 2 ? std::stoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "top")
+    {
+        runTopOfBook();
+        return 0;
+    }
+    if (mode == "topbench")
+    {
+        int updates = argc > 2 ? std::stoi(argv[2]) : 1000000;
+        int readers = argc > 3 ? std::stoi(argv[3]) : 2;
+        runTopOfBookBenchmark(updates, readers);
+        return 0;
+    }
+    if (mode == "diff")
+    {
+        return runDifferentialReplay(argc > 2 ? std::stoi(argv[2]) : 3) ? 0 : 1;
+    }
+    if (mode == "export" && argc > 2)
+    {
+        ExportFormat format = argc > 3 ? TradeExporter::stringToExportFormat(argv[3]) : ExportFormat::csv;
+        int repeats = argc > 4 ? std::stoi(argv[4]) : 20000;
+        bool background = argc > 5 && std::string{argv[5]} == "background";
+        runExport(argv[2], format, repeats, background);
+        return 0;
+    }
+    if (mode == "ratelimit")
+    {
+        unsigned int threads = argc > 2 ? std::stoi(argv[2]) : 4;
+        int attempts = argc > 3 ? std::stoi(argv[3]) : 10000000;
+        runRateLimitBenchmark(threads, attempts);
+        return 0;
+    }
+    if (mode == "sharded")
+    {
+        return runSharded(argc > 2 ? std::stoi(argv[2]) : 2) ? 0 : 1;
+    }
+    if (mode == "snapshot")
+    {
+        runSnapshots(argc > 2 ? std::stoi(argv[2]) : 4);
+        return 0;
+    }
+    if (mode == "history")
+    {
+        runHistory();
+        return 0;
+    }
+    if (mode == "feed" && argc > 2)
+    {
+        runFeed(argv[2]);
+        return 0;
+    }
+    if (mode == "backtest-static")
+    {
+        runStaticBacktest();
+        return 0;
+    }
+
     MerkelMain app{};
     app.init();
 }
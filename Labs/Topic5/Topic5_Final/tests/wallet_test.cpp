@@ -0,0 +1,113 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "../Wallet.h"
+#include "../OrderBookEntry.h"
+
+/**
+ * Test program for the Wallet's profit and loss.
+ * Build from this directory with
+ *   g++ -std=c++17 -pthread wallet_test.cpp ../Wallet.cpp ../CSVReader.cpp
+ *       ../OrderBookEntry.cpp ../ThreadPlacement.cpp ../Profiler.cpp -o wallet_test
+ * and it exits non-zero if any check fails.
+ */
+
+int failures = 0;
+
+void check(const std::string& what, double actual, double expected)
+{
+    bool ok = std::fabs(actual - expected) < 1e-9;
+    std::cout << (ok ? "ok   " : "FAIL ") << what << ": " << actual;
+    if (!ok)
+    {
+        std::cout << " (expected " << expected << ")";
+        failures++;
+    }
+    std::cout << std::endl;
+}
+
+/** selling above the mark realises the difference at the execution price */
+void testSaleAboveMark()
+{
+    std::cout << "\nSelling 1 ETH at 110 after marking it at 100" << std::endl;
+    Wallet wallet{"USDT"};
+    wallet.insertCurrency("ETH", 10);
+    wallet.updateMark("ETH/USDT", 100, 100);
+    wallet.insertCurrency("USDT", 1000);
+
+    OrderBookEntry sale{110, 1, "2020/03/17 17:01:24.884492", "ETH/USDT",
+                        OrderBookType::asksale, "simuser"};
+    wallet.processSale(sale);
+
+    std::map<std::string, Wallet::Position> positions = wallet.getPositions();
+    check("realised PnL", wallet.getRealisedPnl(), 10);
+    check("unrealised PnL", wallet.getUnrealisedPnl(), 0);
+    check("market value", wallet.getMarketValue(), 2010);
+    check("ETH cost", positions["ETH"].costBasis, 900);
+    check("USDT quantity", positions["USDT"].quantity, 1110);
+    check("USDT cost", positions["USDT"].costBasis, 1110);
+}
+
+/** a currency never marked has no cost to take a profit against */
+void testSaleNeverMarked()
+{
+    std::cout << "\nSelling 1000 DOGE at 0.1 without a mark" << std::endl;
+    Wallet wallet{"USDT"};
+    wallet.insertCurrency("DOGE", 1000);
+
+    OrderBookEntry sale{0.1, 1000, "2020/03/17 17:01:24.884492", "DOGE/USDT",
+                        OrderBookType::asksale, "simuser"};
+    wallet.processSale(sale);
+
+    std::map<std::string, Wallet::Position> positions = wallet.getPositions();
+    check("realised PnL", wallet.getRealisedPnl(), 0);
+    check("USDT cost", positions["USDT"].costBasis, 100);
+    check("market value", wallet.getMarketValue(), 100);
+}
+
+/** a sale can spend its reservation and what is free, but no more */
+void testSaleCannotOverdraw()
+{
+    std::cout << "\nSelling 2 ETH out of 1 reserved and 0.5 free" << std::endl;
+    Wallet wallet{"USDT"};
+    wallet.insertCurrency("ETH", 1.5);
+    OrderBookEntry ask{100, 1, "2020/03/17 17:01:24.884492", "ETH/USDT", OrderBookType::ask, "simuser"};
+    ask.orderId = 1;
+    wallet.reserveOrder(ask);
+
+    OrderBookEntry sale{100, 2, ask.timestamp, "ETH/USDT", OrderBookType::asksale, "simuser"};
+    sale.orderId = 1;
+    check("too big a sale is refused", wallet.processSale(sale), 0);
+    check("ETH left", wallet.getCurrencies()["ETH"], 1.5);
+    check("ETH held", wallet.getHeld("ETH"), 1);
+
+    sale.amount = 1.5;
+    check("reservation plus free is taken", wallet.processSale(sale), 1);
+    check("ETH left", wallet.getCurrencies()["ETH"], 0);
+    check("ETH held", wallet.getHeld("ETH"), 0);
+}
+
+/** the value line names what it leaves out for want of a mark */
+void testValueNamesUnpriced()
+{
+    std::cout << "\nValuing USDT and ETH with only ETH marked, and unmarked BTC" << std::endl;
+    Wallet wallet{"USDT"};
+    wallet.insertCurrency("USDT", 1000);
+    wallet.insertCurrency("ETH", 10);
+    wallet.insertCurrency("BTC", 2);
+    wallet.updateMark("ETH/USDT", 100, 100);
+
+    std::string s = wallet.toString();
+    check("market value", wallet.getMarketValue(), 2000);
+    check("BTC named as unpriced", s.find("not counting unpriced BTC\n") != std::string::npos, 1);
+}
+
+int main()
+{
+    testSaleAboveMark();
+    testSaleNeverMarked();
+    testSaleCannotOverdraw();
+    testValueNamesUnpriced();
+    std::cout << "\n" << (failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}